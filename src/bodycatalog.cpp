@@ -0,0 +1,132 @@
+#include "bodycatalog.h"
+#include "terrainnoise.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace ou {
+
+namespace {
+    // file layout: magic, cell count, the cells sorted by CellLess, then the
+    // bodies of every cell in the same order, all in host byte order
+    const char magic[8] = { 'O', 'U', 'C', 'A', 'T', 'L', 'G', '1' };
+
+    struct CellRecord {
+        std::int64_t cell[3];
+        std::uint64_t first;
+        std::uint64_t count;
+    };
+
+    struct BodyRecord {
+        std::int64_t voxel[3];
+        std::int64_t pos[3];
+        std::int64_t radius;
+        double terrainFactor;
+        std::int32_t noisePreset;
+        std::int32_t reserved;
+    };
+}
+
+BodyCatalog::BodyCatalog(std::string const& path)
+    : m_file(path, std::ios::binary)
+{
+    char fileMagic[sizeof(magic)];
+    std::uint64_t cellCount = 0;
+    m_file.read(fileMagic, sizeof(fileMagic));
+    m_file.read(reinterpret_cast<char*>(&cellCount), sizeof(cellCount));
+    if (!m_file || std::memcmp(fileMagic, magic, sizeof(magic)) != 0) {
+        throw std::runtime_error("Not a body catalog: " + path);
+    }
+
+    // the counts come from the file, so check them against its size before
+    // allocating anything for them
+    std::streamoff headerEnd = m_file.tellg();
+    m_file.seekg(0, std::ios::end);
+    std::uint64_t remaining = static_cast<std::uint64_t>(m_file.tellg() - headerEnd);
+    m_file.seekg(headerEnd);
+    if (cellCount > remaining / sizeof(CellRecord)) {
+        throw std::runtime_error("Truncated body catalog: " + path);
+    }
+    std::uint64_t bodyCount = (remaining - cellCount * sizeof(CellRecord)) / sizeof(BodyRecord);
+
+    std::vector<CellRecord> cells(cellCount);
+    m_file.read(reinterpret_cast<char*>(cells.data()), static_cast<std::streamsize>(cells.size() * sizeof(CellRecord)));
+    if (!m_file) {
+        throw std::runtime_error("Truncated body catalog: " + path);
+    }
+    for (CellRecord const& c : cells) {
+        if (c.count > bodyCount || c.first > bodyCount - c.count) {
+            throw std::runtime_error("Body catalog cell out of range: " + path);
+        }
+        m_cells[{ c.cell[0], c.cell[1], c.cell[2] }] = { c.first, c.count };
+    }
+    m_bodiesStart = m_file.tellg();
+}
+
+std::size_t BodyCatalog::cellSize(glm::i64vec3 const& cell) const
+{
+    auto it = m_cells.find(cell);
+    return it == m_cells.end() ? 0 : static_cast<std::size_t>(it->second.count);
+}
+
+std::vector<CatalogBody> BodyCatalog::readCell(glm::i64vec3 const& cell)
+{
+    auto it = m_cells.find(cell);
+    if (it == m_cells.end()) {
+        return {};
+    }
+
+    std::vector<BodyRecord> records(it->second.count);
+    m_file.seekg(m_bodiesStart + static_cast<std::streamoff>(it->second.first * sizeof(BodyRecord)));
+    m_file.read(reinterpret_cast<char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(BodyRecord)));
+    if (!m_file) {
+        m_file.clear();
+        throw std::runtime_error("Failed reading body catalog cell");
+    }
+
+    std::vector<CatalogBody> bodies;
+    bodies.reserve(records.size());
+    for (BodyRecord const& r : records) {
+        if (r.noisePreset < 0 || static_cast<std::size_t>(r.noisePreset) >= noisePresets().size()) {
+            throw std::runtime_error("Body catalog noise preset out of range");
+        }
+        VoxelCoords position{ { r.voxel[0], r.voxel[1], r.voxel[2] }, { r.pos[0], r.pos[1], r.pos[2] } };
+        bodies.push_back({ position, r.radius, r.terrainFactor, r.noisePreset });
+    }
+    return bodies;
+}
+
+void BodyCatalog::write(std::string const& path, std::vector<CatalogBody> const& bodies)
+{
+    std::vector<CatalogBody> sorted = bodies;
+    std::stable_sort(sorted.begin(), sorted.end(), [](CatalogBody const& a, CatalogBody const& b) {
+        return CellLess{}(a.position.voxel, b.position.voxel);
+    });
+
+    std::vector<CellRecord> cells;
+    std::vector<BodyRecord> records;
+    records.reserve(sorted.size());
+    for (CatalogBody const& b : sorted) {
+        glm::i64vec3 const& v = b.position.voxel;
+        if (cells.empty() || CellLess{}(glm::i64vec3(cells.back().cell[0], cells.back().cell[1], cells.back().cell[2]), v)) {
+            cells.push_back({ { v.x, v.y, v.z }, records.size(), 0 });
+        }
+        ++cells.back().count;
+
+        glm::i64vec3 const& p = b.position.pos;
+        records.push_back({ { v.x, v.y, v.z }, { p.x, p.y, p.z }, b.radius, b.terrainFactor,
+            static_cast<std::int32_t>(b.noisePreset), 0 });
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    std::uint64_t cellCount = cells.size();
+    file.write(magic, sizeof(magic));
+    file.write(reinterpret_cast<char const*>(&cellCount), sizeof(cellCount));
+    file.write(reinterpret_cast<char const*>(cells.data()), static_cast<std::streamsize>(cells.size() * sizeof(CellRecord)));
+    file.write(reinterpret_cast<char const*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(BodyRecord)));
+    if (!file) {
+        throw std::runtime_error("Failed writing body catalog: " + path);
+    }
+}
+}
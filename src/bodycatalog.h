@@ -0,0 +1,58 @@
+#ifndef BODYCATALOG_H
+#define BODYCATALOG_H
+
+#include "voxelcoords.h"
+
+#include <fstream>
+#include <glm/glm.hpp>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace ou {
+
+// one body as stored in a catalog
+struct CatalogBody {
+    VoxelCoords position;
+    std::int64_t radius;
+    double terrainFactor;
+    int noisePreset; // index into noisePresets()
+};
+
+// orders cells for use as map keys
+struct CellLess {
+    bool operator()(glm::i64vec3 const& a, glm::i64vec3 const& b) const
+    {
+        return std::tie(a.x, a.y, a.z) < std::tie(b.x, b.y, b.z);
+    }
+};
+
+// Bodies on disk, bucketed by the voxel of their position, so that the
+// bodies around a point can be read without loading the rest. The cell
+// index is read on opening and never changes; cells are read on demand.
+class BodyCatalog {
+public:
+    explicit BodyCatalog(std::string const& path);
+
+    // number of bodies in a cell according to the index
+    std::size_t cellSize(glm::i64vec3 const& cell) const;
+
+    // the bodies in a cell; unlike the index, not safe to use from several threads
+    std::vector<CatalogBody> readCell(glm::i64vec3 const& cell);
+
+    static void write(std::string const& path, std::vector<CatalogBody> const& bodies);
+
+private:
+    struct Entry {
+        std::uint64_t first;
+        std::uint64_t count;
+    };
+
+    std::ifstream m_file;
+    std::map<glm::i64vec3, Entry, CellLess> m_cells;
+    std::streamoff m_bodiesStart = 0;
+};
+}
+
+#endif // BODYCATALOG_H
@@ -0,0 +1,80 @@
+#include "catalogstreamer.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace ou {
+
+CatalogStreamer::CatalogStreamer(std::string const& path)
+    : m_catalog(path)
+    , m_thread(&CatalogStreamer::run, this)
+{
+}
+
+CatalogStreamer::~CatalogStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+BodyCatalog const& CatalogStreamer::catalog() const
+{
+    return m_catalog;
+}
+
+void CatalogStreamer::request(glm::i64vec3 const& cell)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_requests.push_back(cell);
+    }
+    m_wake.notify_one();
+}
+
+void CatalogStreamer::cancel(glm::i64vec3 const& cell)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_requests.erase(std::remove(m_requests.begin(), m_requests.end(), cell), m_requests.end());
+}
+
+bool CatalogStreamer::poll(LoadedCell& loaded)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_loaded.empty()) {
+        return false;
+    }
+    loaded = std::move(m_loaded.front());
+    m_loaded.pop_front();
+    return true;
+}
+
+void CatalogStreamer::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [&] { return m_stop || !m_requests.empty(); });
+        if (m_stop) {
+            return;
+        }
+
+        LoadedCell loaded;
+        loaded.cell = m_requests.front();
+        m_requests.pop_front();
+
+        // only the request queues are shared, the file is read unlocked
+        lock.unlock();
+        try {
+            loaded.bodies = m_catalog.readCell(loaded.cell);
+        } catch (std::exception const& e) {
+            std::cerr << e.what() << std::endl;
+        }
+        lock.lock();
+
+        m_loaded.push_back(std::move(loaded));
+    }
+}
+}
@@ -0,0 +1,57 @@
+#ifndef CATALOGSTREAMER_H
+#define CATALOGSTREAMER_H
+
+#include "bodycatalog.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace ou {
+
+// Reads the cells of a body catalog on a background thread. The main
+// thread requests cells and collects them once read, so that file access
+// never stalls a frame.
+class CatalogStreamer {
+public:
+    struct LoadedCell {
+        glm::i64vec3 cell;
+        std::vector<CatalogBody> bodies;
+    };
+
+    explicit CatalogStreamer(std::string const& path);
+    ~CatalogStreamer();
+
+    CatalogStreamer(CatalogStreamer const&) = delete;
+    CatalogStreamer& operator=(CatalogStreamer const&) = delete;
+
+    // the index can be queried from the main thread
+    BodyCatalog const& catalog() const;
+
+    // read a cell, after the ones requested before it
+    void request(glm::i64vec3 const& cell);
+
+    // drop a request that has not been read yet
+    void cancel(glm::i64vec3 const& cell);
+
+    // take a read cell, returns false if there is none
+    bool poll(LoadedCell& loaded);
+
+private:
+    void run();
+
+    BodyCatalog m_catalog;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<glm::i64vec3> m_requests;
+    std::deque<LoadedCell> m_loaded;
+    bool m_stop = false;
+
+    // started last, once everything it uses is constructed
+    std::thread m_thread;
+};
+}
+
+#endif // CATALOGSTREAMER_H
@@ -3,6 +3,8 @@
 
 #include "circularbuffer.h"
 #include "devicebuffer.h"
+#include "heightquery.h"
+#include "terrainpyramid.h"
 #include "texture.h"
 #include "voxelcoords.h"
 #include <glm/glm.hpp>
@@ -18,6 +20,50 @@ struct SceneComponent {
     VoxelCoords position;
     glm::dvec3 lookDirection = { 0, 0, -1 };
     glm::dvec3 upDirection = { 0, 1, 0 };
+
+    // camera velocity from the last update, in mm/s
+    glm::dvec3 velocity{};
+
+    // GPU time spent generating terrain, and eroding it, since last reported, in ms
+    double terrainGenerationTime = 0.0;
+    double terrainErosionTime = 0.0;
+
+    // planet instances drawn, and culled before drawing, since last reported
+    int drawnInstances = 0;
+    int culledInstances = 0;
+};
+
+// Camera relative state of every planet for the current frame, rebuilt in
+// one pass by the TransformSystem. Planets find theirs at transformIndex.
+struct BodyTransforms {
+    // world positions, and their exact differences to the camera
+    VoxelCoordsArray positions, relative;
+
+    // more than a voxel away from the camera
+    std::vector<std::uint8_t> far;
+
+    // rotation of each planet's frame about z
+    std::vector<double> cosAngle, sinAngle;
+
+    // the camera in the planet's rotated frame, in mm
+    std::vector<double> eyeX, eyeY, eyeZ;
+
+    std::size_t size() const { return far.size(); }
+    glm::dmat4 rotation(std::size_t i) const
+    {
+        // world to planet frame, a rotation by -angle about z
+        glm::dmat4 m(1.0);
+        m[0][0] = m[1][1] = cosAngle[i];
+        m[0][1] = -sinAngle[i];
+        m[1][0] = sinAngle[i];
+        return m;
+    }
+    glm::dvec3 eye(std::size_t i) const { return { eyeX[i], eyeY[i], eyeZ[i] }; }
+};
+
+// marks a planet paged in from a body catalog, with the cell it came from
+struct CatalogMember {
+    glm::i64vec3 cell;
 };
 
 struct PlanetRenderStates;
@@ -28,6 +74,10 @@ struct PlanetComponent {
     double terrainFactor = 0.0012;
     double angle = 0.0;
     std::int64_t playerTerrainHeight = 0;
+    int noisePreset = 0; // index into noisePresets()
+    HeightQueries heightQueries{};
+    TerrainPyramid terrainPyramid{};
+    std::size_t transformIndex = 0;
 
     std::shared_ptr<PlanetRenderStates> r{};
 };
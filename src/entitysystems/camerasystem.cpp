@@ -59,25 +59,29 @@ void CameraSystem::update(ECSEngine& engine, float deltaTime)
     double moveAmount = static_cast<double>(deltaTime) * speed;
 
     Input const& input = engine.getOne<Input>();
+    glm::dvec3 motion{};
     if (input.isKeyPressed('a')) {
-        scene.position += VoxelCoords{ {}, right * moveAmount };
+        motion += right * moveAmount;
     }
     if (input.isKeyPressed('d')) {
-        scene.position -= VoxelCoords{ {}, right * moveAmount };
+        motion -= right * moveAmount;
     }
     if (input.isKeyPressed('r')) {
-        scene.position += VoxelCoords{ {}, scene.upDirection * moveAmount };
+        motion += scene.upDirection * moveAmount;
     }
     if (input.isKeyPressed('f')) {
-        scene.position -= VoxelCoords{ {}, scene.upDirection * moveAmount };
+        motion -= scene.upDirection * moveAmount;
     }
     if (input.isKeyPressed('w')) {
-        scene.position += VoxelCoords{ {}, scene.lookDirection * moveAmount };
+        motion += scene.lookDirection * moveAmount;
     }
     if (input.isKeyPressed('s')) {
-        scene.position -= VoxelCoords{ {}, scene.lookDirection * moveAmount };
+        motion -= scene.lookDirection * moveAmount;
     }
 
+    scene.position += VoxelCoords{ {}, motion };
+    scene.velocity = deltaTime > 0 ? motion / static_cast<double>(deltaTime) : glm::dvec3();
+
     // stop at player height
     if (nearest) {
         glm::i64vec3 diff = (scene.position - nearest->position).pos;
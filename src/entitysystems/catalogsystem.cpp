@@ -0,0 +1,130 @@
+#include "catalogsystem.h"
+#include "catalogstreamer.h"
+#include "components.h"
+#include "ecsengine.h"
+#include "parameters.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace ou {
+
+CatalogSystem::CatalogSystem(std::string const& path)
+    : m_streamer(std::make_unique<CatalogStreamer>(path))
+{
+}
+
+CatalogSystem::~CatalogSystem() = default;
+
+void CatalogSystem::evict(ECSEngine& engine, glm::i64vec3 const& cell)
+{
+    engine.removeEntities<CatalogMember>([&](Entity& ent) {
+        return ent.get<CatalogMember>().cell == cell;
+    });
+
+    auto it = m_resident.find(cell);
+    m_bodyCount -= it->second;
+    m_resident.erase(it);
+}
+
+void CatalogSystem::update(ECSEngine& engine, float)
+{
+    SceneComponent const& scene = engine.getOne<SceneComponent>();
+    Parameters const& params = engine.getOne<Parameters>();
+
+    const glm::i64vec3 center = scene.position.voxel;
+    auto distance = [&](glm::i64vec3 const& cell) {
+        return glm::length(glm::dvec3(cell - center));
+    };
+    auto outside = [&](glm::i64vec3 const& cell, std::int64_t radius) {
+        glm::i64vec3 d = cell - center;
+        return std::max({ std::abs(d.x), std::abs(d.y), std::abs(d.z) }) > radius;
+    };
+
+    // bring in the cells read since the last frame
+    CatalogStreamer::LoadedCell loaded;
+    while (m_streamer->poll(loaded)) {
+        auto it = m_pending.find(loaded.cell);
+        if (it == m_pending.end()) {
+            // dropped while being read
+            continue;
+        }
+        m_bodyCount -= it->second;
+        m_pending.erase(it);
+
+        for (CatalogBody const& body : loaded.bodies) {
+            PlanetComponent planet;
+            planet.position = body.position;
+            planet.radius = body.radius;
+            planet.terrainFactor = body.terrainFactor;
+            planet.noisePreset = body.noisePreset;
+            engine.addEntity(Entity({ planet, CatalogMember{ loaded.cell } }));
+        }
+        m_resident[loaded.cell] = loaded.bodies.size();
+        m_bodyCount += loaded.bodies.size();
+    }
+
+    // drop cells that left the hysteresis radius
+    const std::int64_t keepRadius = params.catalogLoadRadius + params.catalogHysteresis;
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+        if (outside(it->first, keepRadius)) {
+            m_streamer->cancel(it->first);
+            m_bodyCount -= it->second;
+            it = m_pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    std::vector<glm::i64vec3> leaving;
+    for (auto const& cell : m_resident) {
+        if (outside(cell.first, keepRadius)) {
+            leaving.push_back(cell.first);
+        }
+    }
+    for (glm::i64vec3 const& cell : leaving) {
+        evict(engine, cell);
+    }
+
+    // request the missing cells in the load radius, nearest first
+    const std::int64_t r = params.catalogLoadRadius;
+    BodyCatalog const& catalog = m_streamer->catalog();
+    std::vector<glm::i64vec3> missing;
+    for (std::int64_t z = -r; z <= r; ++z) {
+        for (std::int64_t y = -r; y <= r; ++y) {
+            for (std::int64_t x = -r; x <= r; ++x) {
+                glm::i64vec3 cell = center + glm::i64vec3(x, y, z);
+                if (!m_resident.count(cell) && !m_pending.count(cell) && catalog.cellSize(cell) > 0) {
+                    missing.push_back(cell);
+                }
+            }
+        }
+    }
+    std::sort(missing.begin(), missing.end(), [&](glm::i64vec3 const& a, glm::i64vec3 const& b) {
+        return distance(a) < distance(b);
+    });
+
+    const std::size_t budget = static_cast<std::size_t>(params.catalogBodyBudget);
+    for (glm::i64vec3 const& cell : missing) {
+        std::size_t count = catalog.cellSize(cell);
+
+        // make room by dropping the farthest cells beyond this one
+        while (m_bodyCount + count > budget) {
+            auto farthest = std::max_element(m_resident.begin(), m_resident.end(), [&](auto const& a, auto const& b) {
+                return distance(a.first) < distance(b.first);
+            });
+            if (farthest == m_resident.end() || distance(farthest->first) <= distance(cell)) {
+                break;
+            }
+            evict(engine, farthest->first);
+        }
+        if (m_bodyCount + count > budget) {
+            // the remaining cells are no nearer
+            break;
+        }
+
+        m_streamer->request(cell);
+        m_pending[cell] = count;
+        m_bodyCount += count;
+    }
+}
+}
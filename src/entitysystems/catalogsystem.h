@@ -0,0 +1,39 @@
+#ifndef CATALOGSYSTEM_H
+#define CATALOGSYSTEM_H
+
+#include "bodycatalog.h"
+#include "entitysystem.h"
+
+#include <map>
+#include <memory>
+#include <string>
+
+namespace ou {
+
+class CatalogStreamer;
+
+// Pages the bodies of a catalog in and out of the engine around the camera.
+// Cells within catalogLoadRadius voxels of the camera's voxel are loaded,
+// nearest first, as long as the bodies fit into catalogBodyBudget; farther
+// cells make room for nearer ones. Cells are only dropped once they are
+// catalogHysteresis voxels beyond the load radius, so moving back and forth
+// across a voxel border doesn't reload them.
+class CatalogSystem : public EntitySystem {
+public:
+    explicit CatalogSystem(std::string const& path);
+    ~CatalogSystem() override;
+
+    void update(ECSEngine& engine, float deltaTime) override;
+
+private:
+    void evict(ECSEngine& engine, glm::i64vec3 const& cell);
+
+    std::unique_ptr<CatalogStreamer> m_streamer;
+
+    // body count of each cell in the engine, and of each being read
+    std::map<glm::i64vec3, std::size_t, CellLess> m_resident, m_pending;
+    std::size_t m_bodyCount = 0;
+};
+}
+
+#endif // CATALOGSYSTEM_H
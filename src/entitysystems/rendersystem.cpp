@@ -2,70 +2,145 @@
 #include "components.h"
 #include "ecsengine.h"
 #include "framebuffer.h"
+#include "glquery.h"
 #include "input.h"
 #include "parameters.h"
 #include "planetmath.h"
+#include "planetmesh.h"
 #include "shaders.h"
+#include "terrainnoise.h"
+#include "terrainculling.h"
+#include "terrainquadtree.h"
+#include "terrainscheduler.h"
 
 #include <GL/glew.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/string_cast.hpp>
+#include <algorithm>
+#include <array>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
 
 namespace ou {
 
+// laid out as std430, so the culling shader can read and copy it
 struct InstanceAttrib {
-    glm::vec2 offset;
-    short side;
-    float scale;
-    glm::vec4 discardRegion;
-    short texIdx;
+    glm::vec4 discardRegion{};
+    glm::vec2 offset{};
+    glm::vec2 texAlign{};
+
+    // the parent layer's storage, and the layer's center in the parent's
+    // layer-local coordinates
+    glm::vec2 parentTexAlign{};
+    glm::vec2 parentOffset{};
+
+    // the part of the layer drawn, as offset and scale in layer-local coordinates
+    glm::vec3 node{ 0, 0, 1 };
+    float scale = 1.0f;
+
+    // width of the band along the edge, in layer-local units, over which the
+    // grid and heights morph into those of the parent layer; 0 disables it
+    float morphBand = 0.0f;
+    int side = 0;
+    int texIdx = 0;
+    int parentTexIdx = 0;
+};
+static_assert(sizeof(InstanceAttrib) == 80, "std430 layout of instancecull.comp");
+
+// an element of the planet shaders' Planets buffer, std430
+struct PlanetData {
+    glm::mat4 viewProjMat;
+    glm::vec4 xJac;
+    glm::vec4 yJac;
+    glm::vec4 xxCurv;
+    glm::vec4 xyCurv;
+    glm::vec4 yyCurv;
+    glm::vec4 eyeOffset;
+    glm::vec4 lightDir;
+    glm::vec4 eyePos;
+    glm::vec2 origin;
+    glm::vec2 uBase;
+    int playerSide;
+    float terrainFactor;
+    float radius;
+    int gridSize;
+};
+static_assert(sizeof(PlanetData) % 16 == 0, "std430 array stride");
+
+// a planet's share of the instance culling, as instancecull.comp reads it
+struct CullItem {
+    GLuint first;
+    GLuint count;
+    GLuint draw;
+    float occluderHeight;
+    float horizonAngle;
+};
+
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
 };
 
 RenderSystem::RenderSystem(const Parameters& params)
-    : m_hdrShader(quadVertShaderSrc, hdrFragShaderSrc)
-    , m_planetShader(planetVertShaderSrc, planetFragShaderSrc)
-    , m_terrainGenerator(terrainShaderSrc)
+    : m_drawParameters(GLEW_ARB_shader_draw_parameters != 0)
+    , m_hdrShader(quadVertShaderSrc, hdrFragShaderSrc)
+    , m_planetShader(planetVertShaderSource(m_drawParameters).c_str(), planetFragShaderSrc)
     , m_terrainDetailGenerator(terrain2ShaderSrc)
-    , m_skyFromSpaceShader(skyFromSpaceVertShaderSrc, skyFromSpaceFragShaderSrc)
+    , m_terrainRangeSetup(terrainRangeShaderSrc)
+    , m_terrainEroder(erosionShaderSource().c_str())
+    , m_heightQueryShader(heightQueryShaderSrc)
+    , m_minMaxBuilder(minMaxShaderSrc)
+    , m_instanceCuller(instanceCullShaderSrc)
+    , m_survivorCapacity(0)
+    , m_cullFrame(0)
+    , m_skyFromSpaceShader(skyFromSpaceVertShaderSource(m_drawParameters).c_str(), skyFromSpaceFragShaderSrc)
+    , m_frameData(4 << 20)
 {
-    glEnable(GL_CULL_FACE);
+    if (params.terrainErosion && params.erosionIterations > maxErosionIterations) {
+        std::cerr << "Erosion iterations above the limit of " << maxErosionIterations << "\n";
+        throw std::runtime_error("Too many erosion iterations");
+    }
 
-    {
-        // Create vertex buffer and fill it
-        std::vector<glm::vec2> gridPoints;
-        for (float col = 0; col < params.gridSize; ++col) {
-            for (float row = 0; row < params.gridSize; ++row) {
-                gridPoints.push_back({ row, col });
-                gridPoints.push_back({ row + 1, col });
-                gridPoints.push_back({ row + 1, col + 1 });
+    for (NoisePreset const& preset : noisePresets()) {
+        m_terrainGenerators.emplace_back(terrainShaderSource(preset).c_str());
+    }
 
-                gridPoints.push_back({ row, col });
-                gridPoints.push_back({ row + 1, col + 1 });
-                gridPoints.push_back({ row, col + 1 });
-            }
-        }
+    glEnable(GL_CULL_FACE);
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &m_uboAlignment);
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &m_ssboAlignment);
 
-        for (auto& point : gridPoints) {
-            point = point / static_cast<float>(params.gridSize) * 2.f - 1.f;
-        }
+    for (CullStats& stats : m_cullStats) {
+        stats.buf.allocateStorage(2 * sizeof(GLuint), GL_DYNAMIC_READ);
+    }
 
-        m_vertexCount = gridPoints.size();
+    {
+        // Create the indexed grid, in cache friendly order, and fill the buffers
+        PlanetMesh mesh = buildPlanetMesh(params.gridSize);
+        m_indexCount = mesh.indices.size();
 
-        m_meshBuf.setData(gridPoints, GL_STATIC_DRAW);
+        m_meshBuf.setData(mesh.vertices, GL_STATIC_DRAW);
+        m_indexBuf.setData(mesh.indices, GL_STATIC_DRAW);
+        m_planetVao.bindElementBuffer(m_indexBuf);
 
         // Bind vertex buffer to vao binding position 0
         VertexArray::BufferBinding vertexBinding = m_planetVao.getBinding(0);
-        vertexBinding.bindVertexBuffer(m_meshBuf, 0, sizeof(glm::vec2));
+        vertexBinding.bindVertexBuffer(m_meshBuf, 0, sizeof(glm::vec3));
 
         // Enable attribute location 0
         VertexArray::Attribute posAttr = m_planetVao.enableVertexAttrib(0);
-        posAttr.setFormat(2, GL_FLOAT, GL_FALSE, 0);
+        posAttr.setFormat(3, GL_FLOAT, GL_FALSE, 0);
         posAttr.setBinding(vertexBinding);
 
-        // Bind instance buffer to vao attribute location 1
+        // Instances are bound to binding position 1 per pass, the culled
+        // ones for the terrain and the frame data for the sky
         VertexArray::BufferBinding instanceBinding = m_planetVao.getBinding(1);
-        instanceBinding.bindVertexBuffer(m_instanceAttrBuf, 0, sizeof(InstanceAttrib));
         instanceBinding.setBindingDivisor(1);
 
         // Enable instance-wise attribute attribute locations
@@ -74,7 +149,7 @@ RenderSystem::RenderSystem(const Parameters& params)
         offsetAttr.setBinding(instanceBinding);
 
         VertexArray::Attribute sideAttr = m_planetVao.enableVertexAttrib(2);
-        sideAttr.setIFormat(1, GL_SHORT, offsetof(InstanceAttrib, side));
+        sideAttr.setIFormat(1, GL_INT, offsetof(InstanceAttrib, side));
         sideAttr.setBinding(instanceBinding);
 
         VertexArray::Attribute scaleAttr = m_planetVao.enableVertexAttrib(3);
@@ -86,8 +161,32 @@ RenderSystem::RenderSystem(const Parameters& params)
         discardRegionAttr.setBinding(instanceBinding);
 
         VertexArray::Attribute texIdxAttr = m_planetVao.enableVertexAttrib(5);
-        texIdxAttr.setIFormat(1, GL_SHORT, offsetof(InstanceAttrib, texIdx));
+        texIdxAttr.setIFormat(1, GL_INT, offsetof(InstanceAttrib, texIdx));
         texIdxAttr.setBinding(instanceBinding);
+
+        VertexArray::Attribute texAlignAttr = m_planetVao.enableVertexAttrib(6);
+        texAlignAttr.setFormat(2, GL_FLOAT, GL_FALSE, offsetof(InstanceAttrib, texAlign));
+        texAlignAttr.setBinding(instanceBinding);
+
+        VertexArray::Attribute nodeAttr = m_planetVao.enableVertexAttrib(7);
+        nodeAttr.setFormat(3, GL_FLOAT, GL_FALSE, offsetof(InstanceAttrib, node));
+        nodeAttr.setBinding(instanceBinding);
+
+        VertexArray::Attribute morphBandAttr = m_planetVao.enableVertexAttrib(8);
+        morphBandAttr.setFormat(1, GL_FLOAT, GL_FALSE, offsetof(InstanceAttrib, morphBand));
+        morphBandAttr.setBinding(instanceBinding);
+
+        VertexArray::Attribute parentTexIdxAttr = m_planetVao.enableVertexAttrib(9);
+        parentTexIdxAttr.setIFormat(1, GL_INT, offsetof(InstanceAttrib, parentTexIdx));
+        parentTexIdxAttr.setBinding(instanceBinding);
+
+        VertexArray::Attribute parentTexAlignAttr = m_planetVao.enableVertexAttrib(10);
+        parentTexAlignAttr.setFormat(2, GL_FLOAT, GL_FALSE, offsetof(InstanceAttrib, parentTexAlign));
+        parentTexAlignAttr.setBinding(instanceBinding);
+
+        VertexArray::Attribute parentOffsetAttr = m_planetVao.enableVertexAttrib(11);
+        parentOffsetAttr.setFormat(2, GL_FLOAT, GL_FALSE, offsetof(InstanceAttrib, parentOffset));
+        parentOffsetAttr.setBinding(instanceBinding);
     }
 }
 
@@ -97,69 +196,1011 @@ struct PBOSync {
     GLsync sync;
 };
 
-struct PlanetRenderStates {
+// a texel of one lod, indexed along the whole cube face
+struct TexelKey {
+    int side;
+    int lod;
+    glm::i64vec2 texel;
+
+    bool operator==(TexelKey const& other) const
+    {
+        return side == other.side && lod == other.lod && texel == other.texel;
+    }
+};
+
+struct TexelKeyHash {
+    std::size_t operator()(TexelKey const& key) const
+    {
+        std::size_t h = std::hash<std::int64_t>{}(key.texel.x);
+        h = h * 31 + std::hash<std::int64_t>{}(key.texel.y);
+        return h * 31 + static_cast<std::size_t>(key.side * 64 + key.lod);
+    }
+};
+
+struct HeightReadback {
+    DeviceBuffer queryBuf;
+    DeviceBuffer resultBuf;
+    GLsync sync;
+
+    std::vector<TexelKey> keys;
+    std::vector<HeightQueries::Batch> batches;
+
+    // per query index into keys, or -1 if the height came from the cache
+    std::vector<std::vector<int>> slots;
+};
+
+struct MinMaxReadback {
+    DeviceBuffer buf;
+    GLsync sync;
+
+    int layer;
+    int side;
+    int lod;
+    glm::dvec2 center;
+    double scale;
+    glm::ivec2 shift;
+};
+
+// what a layer holds, which decides whether a move can keep most of it
+struct LayerContents {
+    int lod = -1;
+    glm::i64vec2 snapNums{};
+    int parentLayer = -1;
+    std::uint64_t parentVersion = 0;
+
+    // bumped whenever the layer is generated with a new base
+    std::uint64_t version = 0;
+};
+
+// GPU timestamps around the terrain generation of a frame, and around the
+// erosion of each of its waves
+struct GenerationTiming {
+    GLQuery begin;
+    GLQuery end;
+    int jobs = 0;
+
+    std::vector<GLQuery> erosionStamps{};
+    int erosionWaves = 0;
+};
+
+// a tile generated ahead of the camera
+struct PrefetchedTile {
+    int layer;
+    glm::i64vec2 snapNums;
+};
+
+// top-level heights stay within this range, which encodes them when compressed
+static const glm::vec2 topLevelRange = { -1.0f, 5.0f };
+
+// Texture array layers shared by the terrain of every planet, so GPU memory
+// is bounded by terrainTextureCount however many planets there are. Planets
+// take layers as their lods need them; once none are free, prefetched tiles
+// and then the finest lods of the farthest planet are reclaimed. Planets that
+// are no longer rendered give all of theirs back, and a planet is only
+// rendered once it can have its face layers.
+struct TerrainLayerPool {
+    GLenum heightFormat;
     Texture terrainTextures;
+    Texture terrainGradients;
+    Texture terrainMinMax;
+    int minMaxReadbackLevel;
+    int minMaxTopLevel; // a single texel, the range of the whole layer
     Texture heightBases;
+    glm::vec2 topLevelEncoding;
+
+    std::vector<int> freeLayers{};
+    std::vector<LayerContents> layerContents;
+    std::vector<PlanetRenderStates*> planets{};
+
+    // layers the batch being queued writes or reads, which can't be reclaimed
+    // for another of its jobs before it is dispatched
+    std::vector<int> pinned{};
+
+    // heights of the layers a wave erodes as they were generated, one per
+    // erosion item, grown as needed
+    Texture erosionSource{};
+    int erosionSourceLayers = 0;
+
+    TerrainLayerPool(Parameters const& params)
+        : heightFormat(params.compressTerrainTextures ? GL_R16 : GL_R32F)
+        , terrainTextures(GL_TEXTURE_2D_ARRAY)
+        , terrainGradients(GL_TEXTURE_2D_ARRAY)
+        , terrainMinMax(GL_TEXTURE_2D_ARRAY)
+        , heightBases(GL_TEXTURE_1D)
+        , topLevelEncoding(params.compressTerrainTextures
+                  ? glm::vec2(topLevelRange.y - topLevelRange.x, topLevelRange.x)
+                  : glm::vec2(1.0f, 0.0f))
+        , layerContents(params.terrainTextureCount)
+    {
+        for (int layer = params.terrainTextureCount - 1; layer >= 0; --layer) {
+            freeLayers.push_back(layer);
+        }
+
+        // terrainTextures, stored toroidally so that moving a layer keeps the texels
+        // its old and new position share
+        terrainTextures.setWrapS(GL_REPEAT);
+        terrainTextures.setWrapT(GL_REPEAT);
+        terrainTextures.setMinFilter(GL_LINEAR);
+        terrainTextures.setMagFilter(GL_LINEAR);
+        terrainTextures.allocateStoarge3D(1, heightFormat,
+            params.terrainTextureSize, params.terrainTextureSize, // width, height
+            params.terrainTextureCount); // array size
+
+        // terrainGradients, per-texel height gradient along each layer
+        terrainGradients.setWrapS(GL_REPEAT);
+        terrainGradients.setWrapT(GL_REPEAT);
+        terrainGradients.setMinFilter(GL_LINEAR);
+        terrainGradients.setMagFilter(GL_LINEAR);
+        terrainGradients.allocateStoarge3D(1, GL_RG16F,
+            params.terrainTextureSize, params.terrainTextureSize, // width, height
+            params.terrainTextureCount); // array size
+
+        // terrainMinMax, min/max height pyramid of each layer down to a texel,
+        // read back at the readback size
+        minMaxReadbackLevel = 0;
+        while ((params.terrainTextureSize / 2 >> (minMaxReadbackLevel + 1)) >= params.minMaxReadbackSize) {
+            ++minMaxReadbackLevel;
+        }
+        minMaxTopLevel = 0;
+        while ((params.terrainTextureSize / 2 >> minMaxTopLevel) > 1) {
+            ++minMaxTopLevel;
+        }
+        terrainMinMax.allocateStoarge3D(minMaxTopLevel + 1, GL_RG32F,
+            params.terrainTextureSize / 2, params.terrainTextureSize / 2, // width, height
+            params.terrainTextureCount); // array size
+
+        // heightBases, accumulated base and the scale and offset that decode each layer;
+        // compressed detail layers get their encoding from the terrain range setup,
+        // uncompressed ones keep this one, which the generators only carry along
+        heightBases.allocateStorage1D(1, GL_RGBA32F, params.terrainTextureCount);
+        std::vector<glm::vec4> bases(params.terrainTextureCount, glm::vec4(0.0f, 0.0f, topLevelEncoding.x, topLevelEncoding.y));
+        heightBases.uploadTexture1D(0, 0, params.terrainTextureCount, GL_RGBA, GL_FLOAT, bases);
+    }
+
+    // a free layer, or -1 if there is none
+    int take()
+    {
+        if (freeLayers.empty()) {
+            return -1;
+        }
+        int layer = freeLayers.back();
+        freeLayers.pop_back();
+        return layer;
+    }
+
+    // hand a layer back; whatever was generated from it can no longer build on it
+    void release(int layer)
+    {
+        layerContents[layer].lod = -1;
+        ++layerContents[layer].version;
+        freeLayers.push_back(layer);
+    }
+
+    // a layer for a lod of the requester, reclaiming one if none is free;
+    // -1 if every layer in use matters more
+    int acquire(PlanetRenderStates& requester, int lod);
+    bool canAcquire(PlanetRenderStates const& requester, int lod) const;
+
+    // whether another planet can have its six face layers, free or reclaimed
+    bool canHostPlanet() const;
+
+private:
+    bool isPinned(int layer) const
+    {
+        return std::find(pinned.begin(), pinned.end(), layer) != pinned.end();
+    }
+
+    // the planet and lod to reclaim a layer from, prefetched tiles first as they
+    // are only speculative, then the finest lod of the farthest planet; other
+    // planets only give up layers to a requester at most as far away, the
+    // requester only gives up lods finer than the one it asks for, and pinned
+    // layers stay
+    PlanetRenderStates* findVictim(PlanetRenderStates const& requester, int lod,
+        bool& fromPrefetched, int& victimLod) const;
+};
+
+struct PlanetRenderStates {
+    std::shared_ptr<TerrainLayerPool> pool;
     CircularBuffer<PBOSync> pbos;
 
     std::vector<glm::i64vec2> snapNums{};
     std::int64_t baseHeight = 0.0f;
     glm::vec2 storedBase{};
-    DeviceBuffer planetUboBuf{};
-
-    PlanetRenderStates(Parameters const& params, Shader& terrainGenerator)
-        : terrainTextures(GL_TEXTURE_2D_ARRAY)
-        , heightBases(GL_TEXTURE_1D)
+    CircularBuffer<HeightReadback> heightReadbacks;
+    std::unordered_map<TexelKey, std::int64_t, TexelKeyHash> heightCache{};
+    std::vector<MinMaxReadback> minMaxReadbacks{};
+    TerrainScheduler scheduler{};
+    CircularBuffer<GenerationTiming> generationTimings;
+
+    // pool layers of the top-level faces and of the tile of each lod, -1 until
+    // the lod is first generated; tiles ahead of the camera are prefetched into
+    // layers of their own and swapped in once it gets there
+    std::array<int, 6> faceLayers{};
+    std::vector<int> lodLayers;
+    std::unordered_map<int, PrefetchedTile> prefetched{};
+
+    // camera distance when last rendered, the farthest planet gives up layers
+    // first; 0 while the top-level faces are acquired, as the planet cannot
+    // render without them
+    double viewDistance = 0.0;
+
+    PlanetRenderStates(Parameters const& params, std::shared_ptr<TerrainLayerPool> layerPool,
+        Shader& terrainGenerator)
+        : pool(std::move(layerPool))
         , pbos(params.numPbos)
+        , heightReadbacks(params.numPbos)
+        , generationTimings(params.numPbos)
+        , lodLayers(params.maxLods + 1, -1)
     {
-        // terrainTextures
-        terrainTextures.setWrapS(GL_CLAMP_TO_BORDER);
-        terrainTextures.setWrapT(GL_CLAMP_TO_BORDER);
-        terrainTextures.setMinFilter(GL_LINEAR);
-        terrainTextures.setMagFilter(GL_LINEAR);
-        terrainTextures.allocateStoarge3D(1, GL_R32F,
-            params.terrainTextureSize, params.terrainTextureSize, // width, height
-            params.terrainTextureCount); // array size
+        pool->planets.push_back(this);
+        for (int side = 0; side < 6; ++side) {
+            faceLayers[side] = pool->acquire(*this, 0);
+            if (faceLayers[side] < 0) {
+                throw std::runtime_error("Terrain layer budget too small for the top-level faces");
+            }
+            std::vector<glm::vec4> data(1, glm::vec4(0.0f, 0.0f, pool->topLevelEncoding.x, pool->topLevelEncoding.y));
+            pool->heightBases.uploadTexture1D(0, faceLayers[side], 1, GL_RGBA, GL_FLOAT, data);
+        }
 
         // initialize top-level lod
+        terrainGenerator.setUniform(1, pool->topLevelEncoding);
         terrainGenerator.use();
-        terrainTextures.useAsImage(0, 0, GL_WRITE_ONLY, GL_R32F);
-        glDispatchCompute(params.terrainTextureSize / 32, params.terrainTextureSize / 32, 6);
-        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        pool->terrainTextures.useAsImage(0, 0, GL_WRITE_ONLY, pool->heightFormat);
+        pool->terrainGradients.useAsImage(4, 0, GL_WRITE_ONLY, GL_RG16F);
+        for (int side = 0; side < 6; ++side) {
+            terrainGenerator.setUniform(2, side);
+            terrainGenerator.setUniform(3, faceLayers[side]);
+            glDispatchCompute(params.terrainTextureSize / 32, params.terrainTextureSize / 32, 1);
+            pool->layerContents[faceLayers[side]].lod = 0;
+        }
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
 
-        // heightBases
-        heightBases.allocateStorage1D(1, GL_RG32F, params.terrainTextureCount);
+        // pbos, height texel followed by the layer's base and encoding
+        for (PBOSync& pbo : pbos) {
+            pbo.buf.allocateStorage(sizeof(GLfloat) * 5, GL_STREAM_COPY);
+        }
 
-        std::vector<glm::vec2> data(params.terrainTextureCount, { 0.0f, 0.0f });
-        heightBases.uploadTexture1D(0, 0, params.terrainTextureCount, GL_RG, GL_FLOAT, data);
+        for (GenerationTiming& timing : generationTimings) {
+            timing.begin = GLQuery(GL_TIMESTAMP);
+            timing.end = GLQuery(GL_TIMESTAMP);
+        }
+    }
 
-        // pbos
-        for (PBOSync& pbo : pbos) {
-            pbo.buf.allocateStorage(sizeof(GLfloat) * 3, GL_STREAM_COPY);
+    ~PlanetRenderStates()
+    {
+        for (int layer : faceLayers) {
+            pool->release(layer);
+        }
+        for (int layer : lodLayers) {
+            if (layer >= 0) {
+                pool->release(layer);
+            }
+        }
+        for (auto const& tile : prefetched) {
+            pool->release(tile.second.layer);
+        }
+        pool->planets.erase(std::find(pool->planets.begin(), pool->planets.end(), this));
+    }
+
+    // the finest lod holding a layer, or 0 if only the faces are
+    int finestLod() const
+    {
+        for (int lod = int(lodLayers.size()) - 1; lod > 0; --lod) {
+            if (lodLayers[lod] >= 0) {
+                return lod;
+            }
+        }
+        return 0;
+    }
+
+    // drop the tile of a lod, along with the finer ones that rest on it
+    void releaseLod(int lod)
+    {
+        pool->release(lodLayers[lod]);
+        lodLayers[lod] = -1;
+        if (int(snapNums.size()) > lod) {
+            snapNums.resize(lod);
+        }
+    }
+};
+
+PlanetRenderStates* TerrainLayerPool::findVictim(PlanetRenderStates const& requester, int lod,
+    bool& fromPrefetched, int& victimLod) const
+{
+    auto outranks = [&](PlanetRenderStates const* planet) {
+        return planet != &requester && planet->viewDistance < requester.viewDistance;
+    };
+
+    for (PlanetRenderStates* planet : planets) {
+        if (outranks(planet)) {
+            continue;
+        }
+        for (auto const& tile : planet->prefetched) {
+            if ((planet != &requester || tile.first > lod) && !isPinned(tile.second.layer)) {
+                fromPrefetched = true;
+                victimLod = tile.first;
+                return planet;
+            }
+        }
+    }
+
+    PlanetRenderStates* victim = nullptr;
+    fromPrefetched = false;
+    for (PlanetRenderStates* planet : planets) {
+        int finest = planet->finestLod();
+        if (finest == 0 || outranks(planet) || (planet == &requester && finest <= lod)
+            || isPinned(planet->lodLayers[finest])) {
+            continue;
+        }
+        if (!victim || planet->viewDistance > victim->viewDistance) {
+            victim = planet;
+            victimLod = finest;
+        }
+    }
+    return victim;
+}
+
+bool TerrainLayerPool::canAcquire(PlanetRenderStates const& requester, int lod) const
+{
+    bool fromPrefetched = false;
+    int victimLod = 0;
+    return !freeLayers.empty() || findVictim(requester, lod, fromPrefetched, victimLod);
+}
+
+bool TerrainLayerPool::canHostPlanet() const
+{
+    std::size_t layers = freeLayers.size();
+    for (PlanetRenderStates const* planet : planets) {
+        layers += planet->prefetched.size();
+        layers += std::count_if(planet->lodLayers.begin() + 1, planet->lodLayers.end(), [](int l) { return l >= 0; });
+    }
+    return layers >= 6;
+}
+
+int TerrainLayerPool::acquire(PlanetRenderStates& requester, int lod)
+{
+    if (freeLayers.empty()) {
+        bool fromPrefetched = false;
+        int victimLod = 0;
+        PlanetRenderStates* victim = findVictim(requester, lod, fromPrefetched, victimLod);
+        if (!victim) {
+            return -1;
+        }
+        if (fromPrefetched) {
+            release(victim->prefetched.at(victimLod).layer);
+            victim->prefetched.erase(victimLod);
+        } else {
+            victim->releaseLod(victimLod);
+        }
+    }
+    return take();
+}
+
+struct TexelLocation {
+    TexelKey key;
+    glm::ivec4 texel; // x, y, layer
+};
+
+// Detail layers are stored toroidally: the texel with index i along the face
+// lives at i mod N, so this is where texel (0, 0) of a layer's window lives.
+static glm::ivec2 layerShift(glm::i64vec2 const& snapNums, Parameters const& params)
+{
+    const std::int64_t size = params.terrainTextureSize;
+    return glm::ivec2(eucmod(snapNums * (size / params.snapSize) - size / 2, size));
+}
+
+// nearest texel of the finest generated lod covering the point
+static TexelLocation locateTexel(PlanetRenderStates const& r, CubeCoords const& point,
+    int playerSide, Parameters const& params)
+{
+    const int size = params.terrainTextureSize;
+    const double cellSize = 1.0 / params.snapSize;
+    const double margin = 4.0 / size;
+
+    int lod = 0;
+    glm::dvec2 local = point.pos;
+    if (point.side == playerSide) {
+        for (int l = int(r.snapNums.size()) - 1; l > 0; --l) {
+            double scale = glm::exp2(static_cast<double>(-l));
+            glm::dvec2 center = glm::dvec2(r.snapNums[l]) * (scale * 2. * cellSize);
+            glm::dvec2 candidate = (point.pos - center) / scale;
+            if (glm::abs(candidate.x) < 1 - margin && glm::abs(candidate.y) < 1 - margin) {
+                lod = l;
+                local = candidate;
+                break;
+            }
+        }
+    }
+
+    // same texture mapping as the planet vertex shader
+    double t = 1.0 / size;
+    glm::dvec2 uv = glm::clamp((local + 1.0) * .5, t * .5, 1 - t * .5);
+    glm::ivec2 texel = glm::clamp(glm::ivec2(glm::floor(uv * double(size))), 0, size - 1);
+
+    TexelLocation location;
+    location.key.side = point.side;
+    location.key.lod = lod;
+    location.key.texel = glm::i64vec2(texel);
+    if (lod > 0) {
+        location.key.texel += r.snapNums[lod] * std::int64_t(size / params.snapSize) - std::int64_t(size / 2);
+    }
+    if (lod > 0) {
+        location.texel = glm::ivec4((texel + layerShift(r.snapNums[lod], params)) % size, r.lodLayers[lod], 0);
+    } else {
+        location.texel = glm::ivec4(texel, r.faceLayers[point.side], 0);
+    }
+    return location;
+}
+
+// answer height queries from the CPU noise, for planets without terrain textures;
+// this is the top-level terrain as terrain.comp generates it, so detail is cut at
+// the texel spacing of the top-level layers
+static void resolveOnCpu(PlanetComponent& planet, Parameters const& params, HeightQueries::Batch&& batch)
+{
+    const double heightScale = planet.terrainFactor * static_cast<double>(planet.radius);
+    const float maxFreq = params.terrainTextureSize / 4.0f;
+    NoisePreset const& preset = noisePresets()[planet.noisePreset];
+
+    batch.heights.resize(batch.directions.size());
+    for (std::size_t i = 0; i < batch.directions.size(); ++i) {
+        double elevation = topLevelElevation(glm::vec3(batch.directions[i]), preset, maxFreq);
+        batch.heights[i] = std::int64_t(elevation * heightScale);
+    }
+    planet.heightQueries.resolve(std::move(batch));
+}
+
+static void resolveHeightQueriesOnCpu(PlanetComponent& planet, Parameters const& params)
+{
+    for (HeightQueries::Batch& batch : planet.heightQueries.takePending()) {
+        resolveOnCpu(planet, params, std::move(batch));
+    }
+}
+
+// give the layers of a planet that isn't rendered back to the pool; queries
+// still waiting on the GPU are answered on the CPU, and the pyramid, which
+// was built from those layers, starts over
+static void dropRenderStates(PlanetComponent& planet, Parameters const& params)
+{
+    PlanetRenderStates& r = *planet.r;
+    for (; r.heightReadbacks.count(); r.heightReadbacks.pop()) {
+        HeightReadback& readback = r.heightReadbacks.top();
+        glDeleteSync(readback.sync);
+        for (HeightQueries::Batch& batch : readback.batches) {
+            resolveOnCpu(planet, params, std::move(batch));
+        }
+        readback.keys.clear();
+        readback.batches.clear();
+        readback.slots.clear();
+    }
+    for (; r.pbos.count(); r.pbos.pop()) {
+        glDeleteSync(r.pbos.top().sync);
+    }
+    for (MinMaxReadback& readback : r.minMaxReadbacks) {
+        glDeleteSync(readback.sync);
+    }
+
+    planet.r.reset();
+    planet.terrainPyramid = TerrainPyramid();
+    planet.terrainPyramid.setRadius(planet.radius);
+}
+
+// collect finished height readbacks, then serve new queries from the
+// cache and send the misses to the GPU in a single dispatch
+static void serviceHeightQueries(PlanetComponent& planet, int playerSide,
+    Parameters const& params, Shader& heightQueryShader)
+{
+    PlanetRenderStates& r = *planet.r;
+    const double heightScale = planet.terrainFactor * static_cast<double>(planet.radius);
+
+    while (r.heightReadbacks.count()) {
+        HeightReadback& readback = r.heightReadbacks.top();
+
+        GLenum status = glClientWaitSync(readback.sync, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            break;
+        }
+        glDeleteSync(readback.sync);
+
+        std::vector<std::int64_t> texelHeights(readback.keys.size());
+        glm::vec4 const* data = static_cast<glm::vec4 const*>(readback.resultBuf.map(GL_READ_ONLY));
+        for (std::size_t i = 0; i < texelHeights.size(); ++i) {
+            double height = static_cast<double>(data[i].x)
+                + static_cast<double>(data[i].y) + static_cast<double>(data[i].z);
+            texelHeights[i] = std::int64_t(height * heightScale);
+        }
+        readback.resultBuf.unmap();
+
+        if (r.heightCache.size() + texelHeights.size() > std::size_t(params.heightCacheSize)) {
+            r.heightCache.clear();
+        }
+        for (std::size_t i = 0; i < texelHeights.size(); ++i) {
+            r.heightCache[readback.keys[i]] = texelHeights[i];
+        }
+
+        for (std::size_t b = 0; b < readback.batches.size(); ++b) {
+            HeightQueries::Batch& batch = readback.batches[b];
+            for (std::size_t i = 0; i < batch.heights.size(); ++i) {
+                int slot = readback.slots[b][i];
+                if (slot >= 0) {
+                    batch.heights[i] = texelHeights[slot];
+                }
+            }
+            planet.heightQueries.resolve(std::move(batch));
+        }
+
+        readback.keys.clear();
+        readback.batches.clear();
+        readback.slots.clear();
+        r.heightReadbacks.pop();
+    }
+
+    // keep queries pending until a readback buffer frees up
+    if (!planet.heightQueries.pendingCount() || !r.heightReadbacks.available()) {
+        return;
+    }
+
+    std::vector<TexelKey> keys;
+    std::vector<glm::ivec4> texels;
+    std::unordered_map<TexelKey, int, TexelKeyHash> keySlots;
+    std::vector<HeightQueries::Batch> waiting;
+    std::vector<std::vector<int>> slots;
+
+    for (HeightQueries::Batch& batch : planet.heightQueries.takePending()) {
+        batch.heights.assign(batch.directions.size(), 0);
+        std::vector<int> batchSlots(batch.directions.size(), -1);
+        bool complete = true;
+
+        for (std::size_t i = 0; i < batch.directions.size(); ++i) {
+            TexelLocation location = locateTexel(r, cubizePoint(glm::normalize(batch.directions[i])),
+                playerSide, params);
+
+            auto cached = r.heightCache.find(location.key);
+            if (cached != r.heightCache.end()) {
+                batch.heights[i] = cached->second;
+                continue;
+            }
+
+            auto inserted = keySlots.emplace(location.key, int(keys.size()));
+            if (inserted.second) {
+                keys.push_back(location.key);
+                texels.push_back(location.texel);
+            }
+            batchSlots[i] = inserted.first->second;
+            complete = false;
+        }
+
+        if (complete) {
+            planet.heightQueries.resolve(std::move(batch));
+        } else {
+            waiting.push_back(std::move(batch));
+            slots.push_back(std::move(batchSlots));
+        }
+    }
+
+    if (waiting.empty()) {
+        return;
+    }
+
+    HeightReadback& readback = r.heightReadbacks.push();
+    readback.queryBuf.setData(texels, GL_STREAM_DRAW);
+    readback.resultBuf.allocateStorage(sizeof(glm::vec4) * texels.size(), GL_STREAM_READ);
+
+    heightQueryShader.setUniform(0, int(texels.size()));
+    heightQueryShader.use();
+    r.pool->terrainTextures.useAsTexture(1);
+    r.pool->heightBases.useAsImage(2, 0, GL_READ_ONLY, GL_RGBA32F);
+    readback.queryBuf.use(GL_SHADER_STORAGE_BUFFER, 5);
+    readback.resultBuf.use(GL_SHADER_STORAGE_BUFFER, 6);
+    glDispatchCompute(GLuint(texels.size() + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    readback.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback.keys = std::move(keys);
+    readback.batches = std::move(waiting);
+    readback.slots = std::move(slots);
+}
+
+// reduce a freshly generated layer into its min/max pyramid and
+// start reading back the coarsest level
+static void buildMinMaxPyramid(PlanetRenderStates& r, Shader& minMaxBuilder, Parameters const& params,
+    int layer, int side, int lod, glm::dvec2 center, double scale, glm::ivec2 shift)
+{
+    TerrainLayerPool& pool = *r.pool;
+    minMaxBuilder.use();
+    minMaxBuilder.setUniform(1, layer);
+    pool.terrainTextures.useAsTexture(1);
+    pool.heightBases.useAsImage(2, 0, GL_READ_ONLY, GL_RGBA32F);
+
+    for (int level = 0; level <= pool.minMaxTopLevel; ++level) {
+        int size = params.terrainTextureSize / 2 >> level;
+        minMaxBuilder.setUniform(0, level);
+        if (level > 0) {
+            pool.terrainMinMax.useLayerAsImage(3, level - 1, layer, GL_READ_ONLY, GL_RG32F);
         }
+        pool.terrainMinMax.useLayerAsImage(4, level, layer, GL_WRITE_ONLY, GL_RG32F);
+
+        GLuint numWorkGroups = GLuint(size + 15) / 16;
+        glDispatchCompute(numWorkGroups, numWorkGroups, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT
+            | GL_PIXEL_BUFFER_BARRIER_BIT);
     }
+
+    const int readbackSize = params.minMaxReadbackSize;
+    const GLsizei leafBytes = GLsizei(sizeof(glm::vec2)) * readbackSize * readbackSize;
+
+    r.minMaxReadbacks.emplace_back();
+    MinMaxReadback& readback = r.minMaxReadbacks.back();
+    readback.layer = layer;
+    readback.side = side;
+    readback.lod = lod;
+    readback.center = center;
+    readback.scale = scale;
+    readback.shift = shift;
+    readback.buf.allocateStorage(leafBytes + sizeof(glm::vec2), GL_STREAM_READ);
+
+    readback.buf.copyTexture(pool.terrainMinMax, pool.minMaxReadbackLevel,
+        { 0, 0, layer },
+        glm::uvec3(readbackSize, readbackSize, 1),
+        GL_RG, GL_FLOAT, leafBytes,
+        0); // offset into buffer
+
+    readback.buf.copyTexture(pool.heightBases, 0,
+        { layer, 0, 0 },
+        { 1, 1, 1 },
+        GL_RG, GL_FLOAT, sizeof(glm::vec2),
+        leafBytes); // offset into buffer
+
+    readback.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// hand finished min/max readbacks over to the planet's CPU pyramid
+static void collectMinMaxReadbacks(PlanetComponent& planet, Parameters const& params)
+{
+    PlanetRenderStates& r = *planet.r;
+    const double heightScale = planet.terrainFactor * static_cast<double>(planet.radius);
+    const int readbackSize = params.minMaxReadbackSize;
+
+    auto finished = [&](MinMaxReadback& readback) {
+        GLenum status = glClientWaitSync(readback.sync, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            return false;
+        }
+        glDeleteSync(readback.sync);
+
+        // leaves come in the layer's toroidal order, which shifts by whole leaves
+        glm::ivec2 shift = readback.shift / (params.terrainTextureSize / readbackSize);
+
+        std::vector<glm::dvec2> leaves(readbackSize * readbackSize);
+        glm::vec2 const* data = static_cast<glm::vec2 const*>(readback.buf.map(GL_READ_ONLY));
+        glm::vec2 base = data[leaves.size()];
+        double baseSum = static_cast<double>(base.x) + static_cast<double>(base.y);
+        for (int y = 0; y < readbackSize; ++y) {
+            for (int x = 0; x < readbackSize; ++x) {
+                int i = ((y + shift.y) % readbackSize) * readbackSize + (x + shift.x) % readbackSize;
+                leaves[y * readbackSize + x] = (glm::dvec2(data[i]) + baseSum) * heightScale;
+            }
+        }
+        readback.buf.unmap();
+
+        planet.terrainPyramid.setLayer(readback.layer, readback.side, readback.lod,
+            readback.center, readback.scale, params.terrainTextureSize, readbackSize, std::move(leaves));
+        return true;
+    };
+
+    r.minMaxReadbacks.erase(
+        std::remove_if(r.minMaxReadbacks.begin(), r.minMaxReadbacks.end(), finished),
+        r.minMaxReadbacks.end());
+}
+
+// entries of the lod data block, as sized in terrain2 and terrainrange;
+// the first six are the top-level faces
+static const int lodDataCount = 64;
+
+struct LodData {
+    glm::vec2 align;
+    glm::vec2 pDiff;
+    float scale;
+    int imgIdx;
+    int parentIdx;
+    int lod;
+    glm::uvec4 texelOrigin; // 64-bit texel index of (0, 0), split into low and high words
+};
+
+// Layers generated in one frame. Each goes into the first wave after every
+// wave that writes its parent or reads or writes its own layer, so a wave
+// is a single dispatch with one item per z and only the waves need barriers.
+struct TerrainBatch {
+    // std430 layout of an item in terrain2 and terrainrange
+    struct Item {
+        glm::ivec4 region; // physical texels to generate, as offset and size
+        int lodIdx;
+        int incremental;
+        int padding[2];
+    };
+
+    // std430 layout of an item in erosion
+    struct ErosionItem {
+        glm::ivec4 regions[2];
+        int lodIdx;
+        int regionCount;
+        int padding[2];
+    };
+
+    struct Layer {
+        int layer;
+        int side;
+        int lod;
+        glm::dvec2 center;
+        double scale;
+        glm::ivec2 shift;
+    };
+
+    std::vector<LodData> lods;
+    std::vector<std::vector<Item>> waveItems{};
+    std::vector<std::vector<Layer>> waveLayers{};
+    std::vector<std::vector<ErosionItem>> waveErosion{};
+    std::unordered_map<int, int> lastWrite{};
+    std::unordered_map<int, int> lastRead{};
+
+    TerrainBatch(std::array<int, 6> const& faceLayers)
+        : lods(6)
+    {
+        for (int i = 0; i < 6; ++i) {
+            lods[i] = { { 0, 0 }, {}, 1.0f, faceLayers[i], -1, 0, {} };
+        }
+    }
+
+    // room for another job's own and parent entries
+    bool full() const { return lods.size() + 2 > lodDataCount; }
 };
 
-void RenderSystem::render(ECSEngine& engine)
+// add the generation of a job's tile into a layer, upsampled from the parent layer
+static void queueTerrainLayer(TerrainBatch& batch, PlanetRenderStates& r, Parameters const& params, int side,
+    TerrainJob const& job, int layer, int parentLayer, glm::i64vec2 parentSnapNums)
+{
+    const int snapSize = params.snapSize;
+    const double cellSize = 1.0 / snapSize;
+    const int size = params.terrainTextureSize;
+
+    double updatedScale = glm::exp2(static_cast<double>(-job.lod));
+    double mod = updatedScale * 2. * cellSize;
+    glm::dvec2 updatedCenter = glm::dvec2(job.snapNums) * mod;
+    glm::dvec2 pCenter = glm::dvec2(parentSnapNums) * mod * 2.0;
+    glm::ivec2 shift = layerShift(job.snapNums, params);
+
+    // the generators only read the generated layer and its parent, either of
+    // which may be a prefetch layer
+    int parentIdx = side;
+    if (job.lod > 1) {
+        parentIdx = static_cast<int>(batch.lods.size());
+        LodData parentData = {};
+        parentData.align = glm::vec2(layerShift(parentSnapNums, params)) / float(size);
+        parentData.imgIdx = parentLayer;
+        batch.lods.push_back(parentData);
+    }
+
+    LodData lodData;
+    lodData.align = glm::vec2(shift) / float(size);
+    lodData.pDiff = (updatedCenter - pCenter) / (updatedScale * 4);
+    lodData.scale = static_cast<float>(updatedScale);
+    lodData.imgIdx = layer;
+    lodData.parentIdx = parentIdx;
+    lodData.lod = job.lod;
+    glm::i64vec2 origin = job.snapNums * std::int64_t(size / snapSize) - std::int64_t(size / 2);
+    lodData.texelOrigin = glm::uvec4(
+        static_cast<std::uint32_t>(origin.x), static_cast<std::uint32_t>(origin.y),
+        static_cast<std::uint32_t>(origin.x >> 32), static_cast<std::uint32_t>(origin.y >> 32));
+    int lodIdx = static_cast<int>(batch.lods.size());
+    batch.lods.push_back(lodData);
+
+    // a move by less than a window keeps the texels both positions share,
+    // provided their heights are relative to the base the new ones get
+    LayerContents& contents = r.pool->layerContents[layer];
+    glm::i64vec2 delta = job.snapNums - contents.snapNums;
+    glm::i64vec2 moved = glm::abs(delta);
+    bool incremental = !params.compressTerrainTextures && contents.lod == job.lod
+        && contents.parentLayer == parentLayer
+        && contents.parentVersion == r.pool->layerContents[parentLayer].version
+        && std::max(moved.x, moved.y) < snapSize;
+
+    std::vector<glm::ivec4> regions;
+    if (!incremental) {
+        regions.push_back({ 0, 0, size, size });
+    } else {
+        // the exposed L-shaped strip, starting at the first texel index that
+        // entered the window along each axis
+        glm::ivec2 oldShift = layerShift(contents.snapNums, params);
+        glm::ivec2 strip = glm::ivec2(moved) * (size / snapSize);
+        if (delta.x != 0) {
+            regions.push_back({ delta.x > 0 ? oldShift.x : shift.x, 0, strip.x, size });
+        }
+        if (delta.y != 0) {
+            regions.push_back({ 0, delta.y > 0 ? oldShift.y : shift.y, size, strip.y });
+        }
+    }
+
+    if (!incremental) {
+        ++contents.version;
+    }
+    contents.lod = job.lod;
+    contents.snapNums = job.snapNums;
+    contents.parentLayer = parentLayer;
+    contents.parentVersion = r.pool->layerContents[parentLayer].version;
+
+    // after whatever writes the parent, and whatever reads or writes this layer
+    int wave = 0;
+    auto after = [&](std::unordered_map<int, int> const& waves, int l) {
+        auto it = waves.find(l);
+        if (it != waves.end()) {
+            wave = std::max(wave, it->second + 1);
+        }
+    };
+    after(batch.lastWrite, parentLayer);
+    after(batch.lastWrite, layer);
+    after(batch.lastRead, layer);
+    batch.lastWrite[layer] = wave;
+    batch.lastRead[parentLayer] = std::max(batch.lastRead[parentLayer], wave);
+
+    if (wave >= int(batch.waveItems.size())) {
+        batch.waveItems.resize(wave + 1);
+        batch.waveLayers.resize(wave + 1);
+        batch.waveErosion.resize(wave + 1);
+    }
+    for (glm::ivec4 const& region : regions) {
+        batch.waveItems[wave].push_back({ region, lodIdx, incremental ? 1 : 0, {} });
+    }
+    batch.waveLayers[wave].push_back({ layer, side, job.lod, updatedCenter, updatedScale, shift });
+
+    // erosion needs the heights as they are, which compressed layers are not
+    if (params.terrainErosion && !params.compressTerrainTextures) {
+        TerrainBatch::ErosionItem erosion = {};
+        for (glm::ivec4 const& region : regions) {
+            erosion.regions[erosion.regionCount++] = region;
+        }
+        erosion.lodIdx = lodIdx;
+        batch.waveErosion[wave].push_back(erosion);
+    }
+}
+
+void RenderSystem::generateTerrainBatch(PlanetComponent& planet, Parameters const& params, TerrainBatch const& batch,
+    GenerationTiming* timing)
 {
-    SceneComponent const& scene = engine.getOne<SceneComponent>();
+    if (batch.waveItems.empty()) {
+        return;
+    }
+
+    PlanetRenderStates& r = *planet.r;
+    TerrainLayerPool& pool = *r.pool;
+    m_terrainDetailGenerator.setUniform(4, static_cast<int>(noisePresets()[planet.noisePreset].basis));
+
+    std::vector<LodData> lodDataList = batch.lods;
+    lodDataList.resize(lodDataCount);
+    m_frameData.use(GL_UNIFORM_BUFFER, 3, m_frameData.write(lodDataList, m_uboAlignment));
+
+    for (std::size_t wave = 0; wave < batch.waveItems.size(); ++wave) {
+        std::vector<TerrainBatch::Item> const& items = batch.waveItems[wave];
+        m_frameData.use(GL_SHADER_STORAGE_BUFFER, 7, m_frameData.write(items, m_ssboAlignment));
+
+        pool.terrainTextures.useAsTexture(1);
+        pool.heightBases.useAsImage(2, 0, GL_READ_WRITE, GL_RGBA32F);
+
+        // fit the encoding of compressed layers to the parent region and detail amplitude;
+        // compressed layers are always generated whole, as their encoding changes
+        if (params.compressTerrainTextures) {
+            m_terrainRangeSetup.setUniform(1, pool.minMaxReadbackLevel);
+            m_terrainRangeSetup.use();
+            pool.terrainMinMax.useAsTexture(5);
+            glDispatchCompute(1, 1, GLuint(items.size()));
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+
+        // write to textures, all of the wave's layers at once
+        m_terrainDetailGenerator.use();
+        pool.terrainTextures.useAsImage(0, 0, GL_WRITE_ONLY, pool.heightFormat);
+        pool.terrainGradients.useAsImage(4, 0, GL_WRITE_ONLY, GL_RG16F);
+        pool.terrainGradients.useAsTexture(4);
+
+        // one dispatch per size in workgroups, so that strips don't launch the
+        // idle workgroups of a whole layer; the items of a wave are independent
+        std::map<std::pair<GLuint, GLuint>, std::vector<TerrainBatch::Item>> itemsBySize;
+        for (TerrainBatch::Item const& item : items) {
+            itemsBySize[{ GLuint(item.region.z + 31) / 32, GLuint(item.region.w + 31) / 32 }].push_back(item);
+        }
+        for (auto const& group : itemsBySize) {
+            m_frameData.use(GL_SHADER_STORAGE_BUFFER, 7, m_frameData.write(group.second, m_ssboAlignment));
+            glDispatchCompute(group.first.first, group.first.second, GLuint(group.second.size()));
+        }
+        glMemoryBarrier(GL_ALL_BARRIER_BITS);
+
+        // erode the new texels once, here, so the layer keeps the result; tiles
+        // read around themselves from a copy of the layers, so all run at once
+        std::vector<TerrainBatch::ErosionItem> const& erosion = batch.waveErosion[wave];
+        if (!erosion.empty()) {
+            if (timing) {
+                if (int(timing->erosionStamps.size()) < (timing->erosionWaves + 1) * 2) {
+                    timing->erosionStamps.emplace_back(GL_TIMESTAMP);
+                    timing->erosionStamps.emplace_back(GL_TIMESTAMP);
+                }
+                glQueryCounter(timing->erosionStamps[timing->erosionWaves * 2].id(), GL_TIMESTAMP);
+            }
+
+            GLsizei size = params.terrainTextureSize;
+            if (pool.erosionSourceLayers < int(erosion.size())) {
+                pool.erosionSource = Texture(GL_TEXTURE_2D_ARRAY);
+                pool.erosionSource.allocateStoarge3D(1, GL_R32F, size, size, GLsizei(erosion.size()));
+                pool.erosionSourceLayers = int(erosion.size());
+            }
+            for (std::size_t z = 0; z < erosion.size(); ++z) {
+                glCopyImageSubData(pool.terrainTextures.id(), GL_TEXTURE_2D_ARRAY, 0, 0, 0, batch.lods[erosion[z].lodIdx].imgIdx,
+                    pool.erosionSource.id(), GL_TEXTURE_2D_ARRAY, 0, 0, 0, GLint(z), size, size, 1);
+            }
+
+            m_frameData.use(GL_SHADER_STORAGE_BUFFER, 7, m_frameData.write(erosion, m_ssboAlignment));
+            m_terrainEroder.setUniform(0, params.erosionIterations);
+            m_terrainEroder.use();
+            pool.terrainTextures.useAsImage(0, 0, GL_WRITE_ONLY, GL_R32F);
+            pool.terrainGradients.useAsImage(4, 0, GL_READ_WRITE, GL_RG16F);
+            pool.erosionSource.useAsImage(5, 0, GL_READ_ONLY, GL_R32F);
+
+            GLuint tiles = GLuint(size + 31) / 32;
+            glDispatchCompute(tiles, tiles, GLuint(erosion.size()));
+            glMemoryBarrier(GL_ALL_BARRIER_BITS);
+
+            if (timing) {
+                glQueryCounter(timing->erosionStamps[timing->erosionWaves * 2 + 1].id(), GL_TIMESTAMP);
+                ++timing->erosionWaves;
+            }
+        }
+
+        // later waves may fit their encoding to these
+        for (TerrainBatch::Layer const& l : batch.waveLayers[wave]) {
+            buildMinMaxPyramid(r, m_minMaxBuilder, params, l.layer, l.side, l.lod, l.center, l.scale, l.shift);
+        }
+    }
+}
+
+void RenderSystem::render(ECSEngine& engine, float deltaTime)
+{
+    SceneComponent& scene = engine.getOne<SceneComponent>();
     Parameters const& params = engine.getOne<Parameters>();
+    BodyTransforms const& transforms = engine.getOne<BodyTransforms>();
+
+    // every planet drawn is queued, and all are culled and submitted at once
+    // at the end
+    std::vector<InstanceAttrib> candidates, skyInstances;
+    std::vector<CullItem> cullItems;
+    std::vector<PlanetData> planetData;
+    std::vector<DrawElementsIndirectCommand> terrainDraws, skyDraws;
+    GLuint maxCandidates = 0;
 
     for (Entity& ent : engine.iterate<PlanetComponent>()) {
         PlanetComponent& planet = ent.get<PlanetComponent>();
+        const std::size_t body = planet.transformIndex;
+
+        // initialize states
+        if (!m_layerPool) {
+            m_layerPool = std::make_shared<TerrainLayerPool>(params);
+        }
 
-        VoxelCoords centeredPos = scene.position - planet.position;
-        if (centeredPos.voxel != glm::i64vec3()) {
-            // planet is more than a voxel away; skip rendering
-            return;
+        // planet is more than a voxel away, or there are no layers left for
+        // it; skip rendering, and answer its height queries on the CPU
+        if (transforms.far[body] || (!planet.r && !m_layerPool->canHostPlanet())) {
+            if (planet.r) {
+                dropRenderStates(planet, params);
+            }
+            resolveHeightQueriesOnCpu(planet, params);
+            continue;
         }
 
-        glm::dmat4 rotationMat = glm::rotate(glm::dmat4(1.0), -planet.angle, glm::dvec3(0, 0, 1));
-        glm::i64vec3 pos = rotationMat * glm::dvec4(centeredPos.pos, 1);
+        glm::dmat4 rotationMat = transforms.rotation(body);
+        glm::i64vec3 pos = transforms.eye(body);
 
-        // initialize states
         if (!planet.r) {
-            planet.r = std::make_shared<PlanetRenderStates>(params, m_terrainGenerator);
+            planet.r = std::make_shared<PlanetRenderStates>(params, m_layerPool, m_terrainGenerators[planet.noisePreset]);
+            planet.terrainPyramid.setRadius(planet.radius);
+            for (int side = 0; side < 6; ++side) {
+                buildMinMaxPyramid(*planet.r, m_minMaxBuilder, params, planet.r->faceLayers[side], side, 0, {}, 1.0, {});
+            }
         }
 
         glm::dvec3 normPos = glm::normalize(glm::dvec3(pos));
@@ -178,7 +1219,8 @@ void RenderSystem::render(ECSEngine& engine)
         // instance buffer data for lod 0
         std::vector<InstanceAttrib> lod0Attribs(6);
         for (int i = 0; i < 6; ++i) {
-            lod0Attribs[i] = { { 0, 0 }, short(i), 1, {}, short(i) };
+            lod0Attribs[i].side = i;
+            lod0Attribs[i].texIdx = planet.r->faceLayers[i];
             if (i == cubeCoords.side) {
                 lod0Attribs[i].offset = -cubeCoords.pos;
             }
@@ -190,148 +1232,269 @@ void RenderSystem::render(ECSEngine& engine)
         const int logDistance = std::ilogb(normalizedDistance);
         int levelsOfDetail = glm::clamp(params.zoomFactor - logDistance, 1, params.maxLods + 1);
 
-        std::vector<glm::i64vec2> currentSnapNums = { { 0, 0 } };
+        PlanetRenderStates& r = *planet.r;
+        TerrainLayerPool& pool = *r.pool;
+        r.viewDistance = std::max(distance, 1.0);
+        if (r.snapNums.empty()) {
+            r.snapNums.push_back({ 0, 0 });
+        }
+
+        // lods no longer needed give their layers back to the pool
+        for (int lod = levelsOfDetail; lod <= params.maxLods; ++lod) {
+            if (r.lodLayers[lod] >= 0) {
+                r.releaseLod(lod);
+            }
+        }
+        if (int(r.snapNums.size()) > levelsOfDetail) {
+            r.snapNums.resize(levelsOfDetail);
+        }
+        r.scheduler.truncate(levelsOfDetail);
+        for (auto it = r.prefetched.begin(); it != r.prefetched.end();) {
+            if (it->first >= levelsOfDetail) {
+                pool.release(it->second.layer);
+                it = r.prefetched.erase(it);
+            } else {
+                ++it;
+            }
+        }
 
         const int snapSize = params.snapSize;
         const double cellSize = 1.0 / snapSize;
 
-        int lodUpdateIdx = -1;
+        // camera positions over the next frames at its current velocity,
+        // as long as it stays on the same face; they only pick the tiles to
+        // prefetch, so the cubize table is close enough
+        glm::dvec3 frameMotion = glm::dvec3(rotationMat * glm::dvec4(scene.velocity, 0.0)) * static_cast<double>(deltaTime);
+        std::vector<glm::dvec2> predicted;
+        if (frameMotion != glm::dvec3()) {
+            for (int frame = 1; frame <= params.prefetchFrames; ++frame) {
+                CubeCoords ahead = m_cubizeTable.cubize(glm::normalize(glm::dvec3(pos) + frameMotion * static_cast<double>(frame)));
+                if (ahead.side != cubeCoords.side) {
+                    break;
+                }
+                predicted.push_back(ahead.pos);
+            }
+        }
 
-        std::vector<InstanceAttrib> higherLodAttribs;
+        // queue every layer that is missing or no longer centered on the camera,
+        // weighted by the angle its missing or misplaced part subtends, and the
+        // next tile on the predicted path, weighted down by how far ahead it is
+        const double viewDistance = r.viewDistance;
         for (int lod = 1; lod < levelsOfDetail; ++lod) {
             double scale = glm::exp2(static_cast<double>(-lod));
             double mod = scale * 2. * cellSize;
+            double angle = mod * static_cast<double>(planet.radius) / viewDistance;
 
             glm::i64vec2 snapNums = glm::round(cubeCoords.pos / mod);
 
-            bool updateNow = false;
-            if (lodUpdateIdx < 0) {
-                if (lod >= int(planet.r->snapNums.size())) {
-                    updateNow = true;
-                } else if (planet.r->snapNums[lod] != snapNums) {
-                    updateNow = true;
+            bool missing = lod >= int(r.snapNums.size());
+            bool stale = missing || r.snapNums[lod] != snapNums;
+
+            // swap in the prefetched tile once the camera reaches it
+            auto tile = r.prefetched.find(lod);
+            if (stale && lod <= int(r.snapNums.size()) && tile != r.prefetched.end()
+                && tile->second.snapNums == snapNums) {
+                std::swap(r.lodLayers[lod], tile->second.layer);
+                if (tile->second.layer >= 0) {
+                    pool.release(tile->second.layer);
                 }
-            }
+                r.prefetched.erase(tile);
+                tile = r.prefetched.end();
 
-            if (updateNow) {
-                // generate update info
-                lodUpdateIdx = 5 + lod;
+                if (missing) {
+                    r.snapNums.push_back(snapNums);
+                } else {
+                    r.snapNums[lod] = snapNums;
+                }
+                stale = false;
+            }
 
-                std::cout << "Update lod " << lod << " " << snapNums.x << ", " << snapNums.y << std::endl;
+            if (!stale) {
+                r.scheduler.cancel(lod);
+            } else if (missing) {
+                r.scheduler.request({ lod, snapNums, angle * snapSize });
             } else {
-                // parent map pending update, update later
-                snapNums = planet.r->snapNums[lod];
+                r.scheduler.request({ lod, snapNums, angle * glm::length(glm::dvec2(snapNums - r.snapNums[lod])) });
+            }
 
-                if (lod >= int(planet.r->snapNums.size())) {
-                    std::cout << "delayed lod creation " << lod << std::endl;
-                    levelsOfDetail = lod;
-                    break;
+            bool prefetch = false;
+            for (std::size_t frame = 0; frame < predicted.size(); ++frame) {
+                glm::i64vec2 next = glm::round(predicted[frame] / mod);
+                if (next == snapNums) {
+                    continue;
                 }
-                if (planet.r->snapNums[lod] != snapNums) {
-                    std::cout << "delayed update " << lod << std::endl;
+                if (tile == r.prefetched.end() || tile->second.snapNums != next) {
+                    double importance = angle * glm::length(glm::dvec2(next - snapNums)) / static_cast<double>(frame + 2);
+                    r.scheduler.request({ lod, next, importance, true });
+                    prefetch = true;
                 }
+                break;
+            }
+            if (!prefetch) {
+                r.scheduler.cancel(lod, true);
             }
+        }
 
-            if (lod == 1) {
-                glm::dvec2 off = mod * glm::dvec2(snapNums);
-                lod0Attribs[cubeCoords.side].discardRegion = {
-                    -.5 + off.x, -.5 + off.y, .5 + off.x, .5 + off.y
-                };
-            } else if (lod > 1) {
-                glm::ivec2 r = snapNums - currentSnapNums.back() * std::int64_t(2);
-                higherLodAttribs.back().discardRegion = {
-                    -.5 + r.x * cellSize, -.5 + r.y * cellSize, .5 + r.x * cellSize, .5 + r.y * cellSize
-                };
+        // the parent layer and position covering a job, from the parent lod's
+        // tile or its prefetched one; lod 1 always samples the whole top-level face
+        auto findParent = [&](TerrainJob const& job, int& parentLayer, glm::i64vec2& parentSnapNums) {
+            if (job.lod == 1) {
+                parentLayer = r.faceLayers[cubeCoords.side];
+                parentSnapNums = {};
+                return true;
             }
 
-            glm::vec2 offset = mod * glm::dvec2(snapNums) - cubeCoords.pos;
+            auto covers = [&](glm::i64vec2 const& parent) {
+                glm::i64vec2 d = glm::abs(job.snapNums - parent * std::int64_t(2));
+                return std::max(d.x, d.y) < snapSize / 2;
+            };
+            if (job.lod <= int(r.snapNums.size()) && covers(r.snapNums[job.lod - 1])) {
+                parentLayer = r.lodLayers[job.lod - 1];
+                parentSnapNums = r.snapNums[job.lod - 1];
+                return true;
+            }
+            auto tile = r.prefetched.find(job.lod - 1);
+            if (tile != r.prefetched.end() && covers(tile->second.snapNums)) {
+                parentLayer = tile->second.layer;
+                parentSnapNums = tile->second.snapNums;
+                return true;
+            }
+            return false;
+        };
 
-            InstanceAttrib attrib;
-            attrib.offset = offset;
-            attrib.side = short(cubeCoords.side);
-            attrib.scale = static_cast<float>(scale);
-            attrib.discardRegion = {};
-            attrib.texIdx = short(5 + lod);
-            higherLodAttribs.push_back(attrib);
+        // a lod's own tile needs its parent lod to exist and a layer, which may
+        // be reclaimed from elsewhere; a prefetched one only takes free layers
+        auto ready = [&](TerrainJob const& job) {
+            int parentLayer;
+            glm::i64vec2 parentSnapNums;
+            if (!findParent(job, parentLayer, parentSnapNums)) {
+                return false;
+            }
+            if (job.prefetch) {
+                return r.prefetched.count(job.lod) > 0
+                    || (int(r.prefetched.size()) < params.prefetchLayers && !pool.freeLayers.empty());
+            }
+            return job.lod <= int(r.snapNums.size())
+                && (r.lodLayers[job.lod] >= 0 || pool.canAcquire(r, job.lod));
+        };
 
-            currentSnapNums.push_back(snapNums);
+        // generate the most important layers within the frame's budget
+        GenerationTiming* timing = nullptr;
+        if (r.generationTimings.available()) {
+            timing = &r.generationTimings.push();
+            timing->jobs = 0;
+            timing->erosionWaves = 0;
+            glQueryCounter(timing->begin.id(), GL_TIMESTAMP);
         }
-        planet.r->snapNums = currentSnapNums;
 
-        // update terrain textures
-        if (lodUpdateIdx >= 0) {
-            struct LodData {
-                glm::vec2 align;
-                glm::vec2 pDiff;
-                float scale;
-                int imgIdx;
-                int parentIdx;
-                int lod;
-            };
+        r.scheduler.beginFrame(params.terrainGenerationBudget);
+        TerrainBatch batch(r.faceLayers);
+        TerrainJob job;
+        while (!batch.full() && r.scheduler.next(ready, job)) {
+            int parentLayer;
+            glm::i64vec2 parentSnapNums;
+            findParent(job, parentLayer, parentSnapNums);
+
+            int layer;
+            if (job.prefetch) {
+                auto tile = r.prefetched.find(job.lod);
+                if (tile == r.prefetched.end()) {
+                    tile = r.prefetched.emplace(job.lod, PrefetchedTile{ pool.take(), job.snapNums }).first;
+                }
+                tile->second.snapNums = job.snapNums;
+                layer = tile->second.layer;
+            } else {
+                // reclaiming a layer may drop finer lods, never this one's parent
+                if (r.lodLayers[job.lod] < 0) {
+                    r.lodLayers[job.lod] = pool.acquire(r, job.lod);
+                }
+                if (job.lod == int(r.snapNums.size())) {
+                    r.snapNums.push_back(job.snapNums);
+                } else {
+                    r.snapNums[job.lod] = job.snapNums;
+                }
+                layer = r.lodLayers[job.lod];
+                std::cout << "Update lod " << job.lod << " " << job.snapNums.x << ", " << job.snapNums.y << std::endl;
+            }
 
-            std::vector<LodData> lodDataList(params.terrainTextureCount);
-            for (int i = 0; i < 6; ++i) {
-                lodDataList[i] = { { 0, 0 }, {}, 1.0f, i, -1, 0 };
+            pool.pinned.push_back(layer);
+            pool.pinned.push_back(parentLayer);
+            queueTerrainLayer(batch, r, params, cubeCoords.side, job, layer, parentLayer, parentSnapNums);
+            if (timing) {
+                ++timing->jobs;
             }
+        }
+        generateTerrainBatch(planet, params, batch, timing);
+        pool.pinned.clear();
 
-            glm::dvec2 updateCenter;
-            for (int lod = 1; lod < levelsOfDetail; ++lod) {
-                double scale = glm::exp2(static_cast<double>(-lod));
-                double mod = scale * 2. * cellSize;
-                int index = 5 + lod;
-                int parentIdx = lod == 1 ? cubeCoords.side : index - 1;
-                glm::dvec2 center = glm::dvec2(planet.r->snapNums[lod]) * mod;
-                glm::dvec2 pCenter = glm::dvec2(planet.r->snapNums[lod - 1]) * mod * 2.0;
-
-                if (lod == lodUpdateIdx) {
-                    updateCenter = center;
-                }
+        if (timing) {
+            glQueryCounter(timing->end.id(), GL_TIMESTAMP);
+        }
 
-                LodData lodData;
-                lodData.align = glm::dvec2(eucmod(planet.r->snapNums[lod], snapSize)) * cellSize;
-                lodData.pDiff = (center - pCenter) / (scale * 4);
-                lodData.scale = static_cast<float>(scale);
-                lodData.imgIdx = index;
-                lodData.parentIdx = parentIdx;
-                lodData.lod = lod;
-                lodDataList[index] = lodData;
+        // learn the cost of a job from finished timings
+        while (r.generationTimings.count()) {
+            GenerationTiming& top = r.generationTimings.top();
+            GLint available = 0;
+            glGetQueryObjectiv(top.end.id(), GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                break;
             }
 
-            m_lodUboBuf.setData(lodDataList, GL_DYNAMIC_DRAW);
-            m_terrainDetailGenerator.setUniform(0, cubeCoords.side);
+            GLuint64 begin, end;
+            glGetQueryObjectui64v(top.begin.id(), GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(top.end.id(), GL_QUERY_RESULT, &end);
+            r.scheduler.recordCost(static_cast<double>(end - begin) * 1e-6, top.jobs);
+            scene.terrainGenerationTime += static_cast<double>(end - begin) * 1e-6;
 
-            auto updateCenterDrivs = derivatives(updateCenter, cubeCoords.side);
-            m_terrainDetailGenerator.setUniform(1, glm::vec3(updateCenterDrivs.fx));
-            m_terrainDetailGenerator.setUniform(2, glm::vec3(updateCenterDrivs.fy));
+            for (int wave = 0; wave < top.erosionWaves; ++wave) {
+                glGetQueryObjectui64v(top.erosionStamps[wave * 2].id(), GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(top.erosionStamps[wave * 2 + 1].id(), GL_QUERY_RESULT, &end);
+                scene.terrainErosionTime += static_cast<double>(end - begin) * 1e-6;
+            }
+            r.generationTimings.pop();
+        }
 
-            m_terrainDetailGenerator.setUniform(3, lodUpdateIdx);
+        // render the layers that exist, each at the position it was generated at
+        levelsOfDetail = static_cast<int>(r.snapNums.size());
 
-            // write to texture
-            m_terrainDetailGenerator.use();
-            planet.r->terrainTextures.useLayerAsImage(0, 0, lodDataList[lodUpdateIdx].imgIdx, GL_WRITE_ONLY, GL_R32F);
-            planet.r->terrainTextures.useAsTexture(1);
-            planet.r->heightBases.useAsImage(2, 0, GL_READ_WRITE, GL_RG32F);
-            m_lodUboBuf.use(GL_UNIFORM_BUFFER, 3);
+        std::vector<InstanceAttrib> higherLodAttribs;
+        for (int lod = 1; lod < levelsOfDetail; ++lod) {
+            double scale = glm::exp2(static_cast<double>(-lod));
+            double mod = scale * 2. * cellSize;
 
-            const int numWorkGroups = params.terrainTextureSize / 32;
-            glDispatchCompute(numWorkGroups, numWorkGroups, 1);
-            glMemoryBarrier(GL_ALL_BARRIER_BITS);
-        }
+            glm::i64vec2 snapNums = r.snapNums[lod];
 
-        // select LODs to be rendered
-        std::vector<InstanceAttrib> instanceAttribs;
-        if (levelsOfDetail < 10) {
-            instanceAttribs = lod0Attribs;
-            std::copy(higherLodAttribs.begin(), higherLodAttribs.end(),
-                std::back_inserter(instanceAttribs));
-        } else {
-            instanceAttribs.push_back(lod0Attribs[cubeCoords.side]);
-            std::copy(higherLodAttribs.end() - params.maxRenderLods, higherLodAttribs.end(),
-                std::back_inserter(instanceAttribs));
-        }
+            // where this layer lies within its parent
+            glm::dvec2 parentOffset;
+            if (lod == 1) {
+                parentOffset = mod * glm::dvec2(snapNums);
+                lod0Attribs[cubeCoords.side].discardRegion = {
+                    -.5 + parentOffset.x, -.5 + parentOffset.y, .5 + parentOffset.x, .5 + parentOffset.y
+                };
+            } else if (lod > 1) {
+                glm::ivec2 d = snapNums - r.snapNums[lod - 1] * std::int64_t(2);
+                parentOffset = glm::dvec2(d) * cellSize;
+                higherLodAttribs.back().discardRegion = {
+                    -.5 + d.x * cellSize, -.5 + d.y * cellSize, .5 + d.x * cellSize, .5 + d.y * cellSize
+                };
+            }
+            InstanceAttrib const& parent = lod == 1 ? lod0Attribs[cubeCoords.side] : higherLodAttribs.back();
 
-        // upload instance attribs
-        m_instanceAttrBuf.setData(instanceAttribs, GL_STATIC_DRAW);
+            glm::vec2 offset = mod * glm::dvec2(snapNums) - cubeCoords.pos;
+
+            InstanceAttrib attrib;
+            attrib.offset = offset;
+            attrib.side = cubeCoords.side;
+            attrib.scale = static_cast<float>(scale);
+            attrib.discardRegion = {};
+            attrib.texIdx = r.lodLayers[lod];
+            attrib.texAlign = glm::vec2(layerShift(snapNums, params)) / float(params.terrainTextureSize);
+            attrib.morphBand = static_cast<float>(params.morphBand);
+            attrib.parentTexIdx = parent.texIdx;
+            attrib.parentTexAlign = parent.texAlign;
+            attrib.parentOffset = parentOffset;
+            higherLodAttribs.push_back(attrib);
+        }
 
         // build proj view matrix
         glm::dmat4 viewMat = glm::lookAt({}, scene.lookDirection, scene.upDirection)
@@ -339,63 +1502,101 @@ void RenderSystem::render(ECSEngine& engine)
         double aspectRatio = static_cast<double>(scene.windowSize.x) / scene.windowSize.y;
         glm::dmat4 projMat = glm::perspective(glm::radians(90.0), aspectRatio, 0.1, 10.0);
 
-        // set uniforms
-        struct PlanetUbo {
-            glm::mat4 viewProjMat;
-            glm::vec4 xJac;
-            glm::vec4 yJac;
-            glm::vec4 xxCurv;
-            glm::vec4 xyCurv;
-            glm::vec4 yyCurv;
-            glm::vec4 eyeOffset;
-            glm::vec4 lightDir;
-            glm::vec4 eyePos;
-            glm::vec2 origin;
-            glm::vec2 uBase;
-            int playerSide;
-            float terrainFactor;
-            float radius;
-        };
+        // the terrain is nowhere lower than the lowest height generated so
+        // far, nor than the ground under the player
+        const double occluderRadius = static_cast<double>(planet.radius)
+            + std::min({ planet.terrainPyramid.range().x, static_cast<double>(planet.playerTerrainHeight), 0.0 });
+        const HorizonCuller horizon(glm::dvec3(pos), occluderRadius);
+
+        // select LODs to be rendered; the GPU culls what remains
+        std::vector<InstanceAttrib> instanceAttribs;
+        if (params.quadtreeLod) {
+            // the quadtree draws parts of the same layers, without the rings' cutouts
+            std::vector<InstanceAttrib> layerAttribs = lod0Attribs;
+            std::copy(higherLodAttribs.begin(), higherLodAttribs.end(), std::back_inserter(layerAttribs));
+            // the six faces are lod 0, higherLodAttribs holds lod i + 1 at i
+            std::vector<int> layerLods(lod0Attribs.size(), 0);
+            for (int lod = 1; lod < levelsOfDetail; ++lod) {
+                layerLods.push_back(lod);
+            }
+            std::vector<QuadtreeLayer> layers;
+            for (std::size_t i = 0; i < layerAttribs.size(); ++i) {
+                InstanceAttrib& attrib = layerAttribs[i];
+                attrib.discardRegion = {};
+                attrib.morphBand = 0.0f;
+                glm::dvec2 center = glm::dvec2(attrib.offset) + (attrib.side == cubeCoords.side ? cubeCoords.pos : glm::dvec2());
+                layers.push_back({ attrib.side, layerLods[i], center, static_cast<double>(attrib.scale) });
+            }
+
+            QuadtreeView view;
+            view.eye = glm::dvec3(pos);
+            view.viewProj = projMat * viewMat;
+            view.unit = static_cast<double>(params.rUnit);
+            view.planetRadius = static_cast<double>(planet.radius);
+            view.occluderRadius = occluderRadius;
+            view.pixelsPerRadian = scene.windowSize.y * .5; // 90 degrees vertical field of view
+            view.maxPixelError = params.lodPixelError;
+            view.gridSize = params.gridSize;
+            view.textureSize = params.terrainTextureSize;
+            view.maxDepth = params.maxLods;
+
+            TerrainQuadtree quadtree(view, layers, planet.terrainPyramid);
+            for (QuadtreeNode const& node : quadtree.select()) {
+                InstanceAttrib attrib = layerAttribs[node.layer];
+                QuadtreeLayer const& layer = layers[node.layer];
+                attrib.node = glm::vec3((node.center - layer.center) / layer.scale, node.scale / layer.scale);
+                instanceAttribs.push_back(attrib);
+            }
+            scene.culledInstances += quadtree.stats().frustumCulled + quadtree.stats().horizonCulled;
+        } else {
+            if (levelsOfDetail < 10) {
+                instanceAttribs = lod0Attribs;
+                std::copy(higherLodAttribs.begin(), higherLodAttribs.end(),
+                    std::back_inserter(instanceAttribs));
+            } else {
+                instanceAttribs.push_back(lod0Attribs[cubeCoords.side]);
+                std::copy(higherLodAttribs.end() - params.maxRenderLods, higherLodAttribs.end(),
+                    std::back_inserter(instanceAttribs));
+            }
+        }
 
-        PlanetUbo ubo;
-        ubo.viewProjMat = projMat * viewMat;
-        ubo.origin = cubeCoords.pos;
-        ubo.xJac = glm::vec4(derivs.fx, 0);
-        ubo.yJac = glm::vec4(derivs.fy, 0);
-        ubo.xxCurv = glm::vec4(curvs.fxx, 0);
-        ubo.xyCurv = glm::vec4(curvs.fxy, 0);
-        ubo.yyCurv = glm::vec4(curvs.fyy, 0);
-        ubo.playerSide = cubeCoords.side;
-        ubo.eyeOffset = glm::vec4(normOffset, 0);
-        ubo.terrainFactor = static_cast<float>(planet.terrainFactor);
-        ubo.uBase = planet.r->storedBase;
-        ubo.radius = static_cast<float>(normRadius);
-        ubo.lightDir = glm::vec4(0, 0, 1, 0);
-        ubo.eyePos = glm::vec4(glm::dvec3(pos) / static_cast<double>(params.rUnit), 0);
-
-        planet.r->planetUboBuf.setData(RawBufferView(ubo), GL_DYNAMIC_DRAW);
-
-        // render planet
-        m_planetShader.use();
-        m_planetVao.use();
-        planet.r->planetUboBuf.use(GL_UNIFORM_BUFFER, 0);
-        planet.r->terrainTextures.useAsTexture(1);
-        planet.r->heightBases.useAsImage(2, 0, GL_READ_ONLY, GL_RG32F);
-        glDrawArraysInstanced(GL_TRIANGLES, 0, m_vertexCount, instanceAttribs.size());
-
-        // render sky
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_ONE, GL_ONE);
-
-        // sky from space
-        glFrontFace(GL_CW);
-        m_skyFromSpaceShader.use();
-        m_planetVao.use();
-        planet.r->planetUboBuf.use(GL_UNIFORM_BUFFER, 0);
-        glDrawArraysInstanced(GL_TRIANGLES, 0, m_vertexCount, 6);
-        glFrontFace(GL_CCW);
-
-        glDisable(GL_BLEND);
+        // queue the planet's candidates; its draw gets as much room in the
+        // survivor buffer, and its instance count from the culling
+        const GLuint drawIndex = static_cast<GLuint>(planetData.size());
+        CullItem item;
+        item.first = static_cast<GLuint>(candidates.size());
+        item.count = static_cast<GLuint>(instanceAttribs.size());
+        item.draw = drawIndex;
+        item.occluderHeight = static_cast<float>((occluderRadius - static_cast<double>(planet.radius)) / params.rUnit);
+        item.horizonAngle = static_cast<float>(horizon.horizonAngle());
+        cullItems.push_back(item);
+        maxCandidates = std::max(maxCandidates, item.count);
+        terrainDraws.push_back({ GLuint(m_indexCount), 0, 0, 0, item.first });
+        candidates.insert(candidates.end(), instanceAttribs.begin(), instanceAttribs.end());
+
+        // the six faces for the sky are never culled
+        skyDraws.push_back({ GLuint(m_indexCount), 6, 0, 0, GLuint(skyInstances.size()) });
+        skyInstances.insert(skyInstances.end(), lod0Attribs.begin(), lod0Attribs.end());
+
+        // per-planet data, indexed by the draw
+        PlanetData entry;
+        entry.viewProjMat = projMat * viewMat;
+        entry.origin = cubeCoords.pos;
+        entry.xJac = glm::vec4(derivs.fx, 0);
+        entry.yJac = glm::vec4(derivs.fy, 0);
+        entry.xxCurv = glm::vec4(curvs.fxx, 0);
+        entry.xyCurv = glm::vec4(curvs.fxy, 0);
+        entry.yyCurv = glm::vec4(curvs.fyy, 0);
+        entry.playerSide = cubeCoords.side;
+        entry.eyeOffset = glm::vec4(normOffset, 0);
+        entry.terrainFactor = static_cast<float>(planet.terrainFactor);
+        entry.uBase = planet.r->storedBase;
+        entry.radius = static_cast<float>(normRadius);
+        entry.gridSize = params.gridSize;
+        entry.lightDir = glm::vec4(0, 0, 1, 0);
+        entry.eyePos = glm::vec4(glm::dvec3(pos) / static_cast<double>(params.rUnit), 0);
+
+        planetData.push_back(entry);
 
         while (planet.r->pbos.count()) {
             PBOSync& pbo = planet.r->pbos.top();
@@ -405,7 +1606,7 @@ void RenderSystem::render(ECSEngine& engine)
                 glDeleteSync(pbo.sync);
 
                 GLfloat* data = static_cast<GLfloat*>(pbo.buf.map(GL_READ_ONLY));
-                double height = static_cast<double>(data[0]);
+                double height = static_cast<double>(data[0]) * data[3] + data[4];
                 planet.r->storedBase = { data[1], data[2] };
                 double base = static_cast<double>(data[1]) + static_cast<double>(data[2]);
                 pbo.buf.unmap();
@@ -424,30 +1625,121 @@ void RenderSystem::render(ECSEngine& engine)
         if (planet.r->pbos.available() && higherLodAttribs.size()) {
             PBOSync& pbo = planet.r->pbos.push();
 
-            InstanceAttrib hLod = instanceAttribs.back();
-            glm::vec2 coords = (hLod.offset + 1.0f) * 0.5f * float(params.terrainTextureSize);
-            glm::ivec2 iCoords = glm::clamp(glm::ivec2(glm::round(coords)), 0, params.terrainTextureSize);
+            // the finest layer under the player, whatever was selected for drawing
+            InstanceAttrib const& hLod = higherLodAttribs.back();
+            const int size = params.terrainTextureSize;
+            glm::vec2 coords = (hLod.offset + 1.0f) * 0.5f * float(size);
+            glm::ivec2 iCoords = glm::clamp(glm::ivec2(glm::round(coords)), 0, size - 1);
+            iCoords = (iCoords + glm::ivec2(glm::round(hLod.texAlign * float(size)))) % size;
 
             pbo.texIdx = hLod.texIdx;
 
-            pbo.buf.copyTexture(planet.r->terrainTextures, 0,
+            pbo.buf.copyTexture(pool.terrainTextures, 0,
                 { iCoords, pbo.texIdx },
                 { 1, 1, 1 },
                 GL_RED, GL_FLOAT, sizeof(GLfloat) * 1,
                 0); // offset into pbo
 
-            pbo.buf.copyTexture(planet.r->heightBases, 0,
+            pbo.buf.copyTexture(pool.heightBases, 0,
                 { pbo.texIdx, 0, 0 },
                 { 1, 1, 1 },
-                GL_RG, GL_FLOAT, sizeof(GLfloat) * 2,
+                GL_RGBA, GL_FLOAT, sizeof(GLfloat) * 4,
                 sizeof(GLfloat)); // offset into pbo
 
             pbo.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
         }
+
+        serviceHeightQueries(planet, cubeCoords.side, params, m_heightQueryShader);
+        collectMinMaxReadbacks(planet, params);
+    }
+
+    if (planetData.empty()) {
+        return;
+    }
+
+    // the layer pool is shared, so one set of textures serves every planet
+    TerrainLayerPool& pool = *m_layerPool;
+    const GLsizei drawCount = static_cast<GLsizei>(planetData.size());
+
+    if (m_survivorCapacity < candidates.size()) {
+        m_survivorCapacity = std::max(candidates.size(), m_survivorCapacity * 2);
+        m_survivorBuf = DeviceBuffer();
+        m_survivorBuf.allocateStorage(m_survivorCapacity * sizeof(InstanceAttrib), GL_DYNAMIC_COPY);
+    }
+
+    // counts of the culling a few frames ago, which has finished by now
+    CullStats& stats = m_cullStats[m_cullFrame++ % m_cullStats.size()];
+    if (stats.sync) {
+        if (glClientWaitSync(stats.sync, 0, 0) != GL_TIMEOUT_EXPIRED) {
+            GLuint* counts = static_cast<GLuint*>(stats.buf.map(GL_READ_ONLY));
+            scene.drawnInstances += static_cast<int>(counts[0] - counts[1]);
+            scene.culledInstances += static_cast<int>(counts[1]);
+            stats.buf.unmap();
+        }
+        glDeleteSync(stats.sync);
+        stats.sync = nullptr;
+    }
+    glClearNamedBufferData(stats.buf.id(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+    // cull the candidates of every planet into the survivor buffer, counting
+    // them in the terrain draws
+    std::vector<DrawElementsIndirectCommand> draws = terrainDraws;
+    draws.insert(draws.end(), skyDraws.begin(), skyDraws.end());
+    RingBuffer::Range drawRange = m_frameData.write(draws, m_ssboAlignment);
+    m_frameData.use(GL_SHADER_STORAGE_BUFFER, 11, drawRange);
+    m_frameData.use(GL_DRAW_INDIRECT_BUFFER);
+    m_frameData.use(GL_SHADER_STORAGE_BUFFER, 0, m_frameData.write(planetData, m_ssboAlignment));
+    m_frameData.use(GL_SHADER_STORAGE_BUFFER, 10, m_frameData.write(cullItems, m_ssboAlignment));
+    if (!candidates.empty()) {
+        m_frameData.use(GL_SHADER_STORAGE_BUFFER, 8, m_frameData.write(candidates, m_ssboAlignment));
+    }
+    m_survivorBuf.use(GL_SHADER_STORAGE_BUFFER, 9);
+    stats.buf.use(GL_SHADER_STORAGE_BUFFER, 12);
+    pool.heightBases.useAsImage(2, 0, GL_READ_ONLY, GL_RGBA32F);
+    pool.terrainMinMax.useAsImage(3, pool.minMaxTopLevel, GL_READ_ONLY, GL_RG32F);
+    m_instanceCuller.use();
+    glDispatchCompute((maxCandidates + 63) / 64, GLuint(drawCount), 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    stats.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    // render planets
+    m_planetVao.getBinding(1).bindVertexBuffer(m_survivorBuf, 0, sizeof(InstanceAttrib));
+    m_planetShader.use();
+    m_planetVao.use();
+    pool.terrainTextures.useAsTexture(1);
+    pool.heightBases.useAsImage(2, 0, GL_READ_ONLY, GL_RGBA32F);
+    pool.terrainGradients.useAsTexture(4);
+    drawPlanets(m_planetShader, drawRange.offset, drawCount);
+
+    // render sky
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    // sky from space
+    glFrontFace(GL_CW);
+    RingBuffer::Range skyRange = m_frameData.write(skyInstances, sizeof(InstanceAttrib));
+    m_planetVao.getBinding(1).bindVertexBuffer(m_frameData.buffer(), skyRange.offset, sizeof(InstanceAttrib));
+    m_skyFromSpaceShader.use();
+    drawPlanets(m_skyFromSpaceShader, drawRange.offset + drawCount * sizeof(DrawElementsIndirectCommand), drawCount);
+    glFrontFace(GL_CCW);
+
+    glDisable(GL_BLEND);
+}
+
+void RenderSystem::drawPlanets(Shader& shader, GLintptr offset, GLsizei drawCount)
+{
+    if (m_drawParameters) {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<void const*>(offset), drawCount, 0);
+        return;
+    }
+    for (GLsizei draw = 0; draw < drawCount; ++draw) {
+        shader.setUniform(0, static_cast<int>(draw));
+        glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+            reinterpret_cast<void const*>(offset + draw * sizeof(DrawElementsIndirectCommand)));
     }
 }
 
-void RenderSystem::update(ECSEngine& engine, float)
+void RenderSystem::update(ECSEngine& engine, float deltaTime)
 {
     SceneComponent& scene = engine.getOne<SceneComponent>();
     Parameters const& params = engine.getOne<Parameters>();
@@ -501,7 +1793,9 @@ void RenderSystem::update(ECSEngine& engine, float)
     }
 
     // render actual stuff
-    render(engine);
+    m_frameData.beginFrame();
+    render(engine, deltaTime);
+    m_frameData.endFrame();
 
     // apply HDR
     glDisable(GL_DEPTH_TEST);
@@ -5,14 +5,29 @@
 #include "entitysystem.h"
 #include "framebuffer.h"
 #include "parameters.h"
+#include "planetmath.h"
 #include "renderbuffer.h"
+#include "ringbuffer.h"
 #include "shader.h"
 #include "texture.h"
 #include "vertexarray.h"
 
+#include <array>
+#include <memory>
+#include <vector>
+
 namespace ou {
 
+struct GenerationTiming;
+struct PlanetComponent;
+struct TerrainBatch;
+struct TerrainLayerPool;
+
 class RenderSystem : public EntitySystem {
+    // whether a multi-draw can index the planets by gl_DrawIDARB; without
+    // it each planet is drawn on its own
+    bool m_drawParameters;
+
     // HDR
     FrameBuffer m_hdrFrameBuffer;
     Texture m_hdrColorTexture;
@@ -25,22 +40,51 @@ class RenderSystem : public EntitySystem {
 
     // Planet
     Shader m_planetShader;
-    Shader m_terrainGenerator, m_terrainDetailGenerator;
+    std::vector<Shader> m_terrainGenerators; // one per noise preset
+    Shader m_terrainDetailGenerator, m_terrainRangeSetup, m_terrainEroder;
     VertexArray m_planetVao;
-    DeviceBuffer m_meshBuf, m_instanceAttrBuf;
-    std::size_t m_vertexCount;
-    DeviceBuffer m_lodUboBuf;
+    DeviceBuffer m_meshBuf, m_indexBuf;
+    std::size_t m_indexCount;
+    Shader m_heightQueryShader;
+    Shader m_minMaxBuilder;
+    std::shared_ptr<TerrainLayerPool> m_layerPool;
+    CubizeTable m_cubizeTable;
+
+    // Instance culling, into the survivor buffer the terrain is drawn from;
+    // the counts are read back a few frames later
+    struct CullStats {
+        DeviceBuffer buf;
+        GLsync sync = nullptr;
+    };
+    Shader m_instanceCuller;
+    DeviceBuffer m_survivorBuf;
+    std::size_t m_survivorCapacity;
+    std::array<CullStats, RingBuffer::regionCount> m_cullStats;
+    std::size_t m_cullFrame;
 
     // Sky
     Shader m_skyFromSpaceShader;
 
+    // instances, uniforms and work items written every frame
+    RingBuffer m_frameData;
+    GLint m_uboAlignment, m_ssboAlignment;
+
 public:
     RenderSystem(Parameters const& params);
 
     void update(ECSEngine& engine, float deltaTime) override;
 
 private:
-    void render(ECSEngine& engine);
+    void render(ECSEngine& engine, float deltaTime);
+
+    // the draws of every planet from the indirect commands at offset, as one
+    // multi-draw or one draw per planet
+    void drawPlanets(Shader& shader, GLintptr offset, GLsizei drawCount);
+
+    // run the queued layer generation, one dispatch per wave, followed by
+    // the erosion of the wave's new texels
+    void generateTerrainBatch(PlanetComponent& planet, Parameters const& params, TerrainBatch const& batch,
+        GenerationTiming* timing);
 };
 }
 
@@ -1,4 +1,5 @@
 #include "shaders.h"
+#include "terrainnoise.h"
 
 namespace ou {
 const char* const quadVertShaderSrc =
@@ -25,4 +26,45 @@ const char* const terrainShaderSrc =
 const char* const terrain2ShaderSrc =
 #include "shaders/terrain2.comp.glsl"
     ;
+const char* const heightQueryShaderSrc =
+#include "shaders/heightquery.comp.glsl"
+    ;
+const char* const minMaxShaderSrc =
+#include "shaders/minmax.comp.glsl"
+    ;
+const char* const terrainRangeShaderSrc =
+#include "shaders/terrainrange.comp.glsl"
+    ;
+const char* const erosionShaderSrc =
+#include "shaders/erosion.comp.glsl"
+    ;
+const char* const instanceCullShaderSrc =
+#include "shaders/instancecull.comp.glsl"
+    ;
+
+static std::string insertAfterVersion(std::string source, std::string const& defines)
+{
+    std::size_t afterVersion = source.find('\n', source.find("#version")) + 1;
+    return source.insert(afterVersion, defines);
+}
+
+std::string terrainShaderSource(NoisePreset const& preset)
+{
+    return insertAfterVersion(terrainShaderSrc, terrainShapeDefines(preset.shape, preset.basis));
+}
+
+std::string planetVertShaderSource(bool drawParameters)
+{
+    return insertAfterVersion(planetVertShaderSrc, drawParameters ? "#define DRAW_PARAMETERS\n" : "");
+}
+
+std::string skyFromSpaceVertShaderSource(bool drawParameters)
+{
+    return insertAfterVersion(skyFromSpaceVertShaderSrc, drawParameters ? "#define DRAW_PARAMETERS\n" : "");
+}
+
+std::string erosionShaderSource()
+{
+    return insertAfterVersion(erosionShaderSrc, "#define MAX_ITERATIONS " + std::to_string(maxErosionIterations) + "\n");
+}
 }
@@ -1,7 +1,11 @@
 #ifndef SHADERS_H
 #define SHADERS_H
 
+#include <string>
+
 namespace ou {
+struct NoisePreset;
+
 extern const char* const quadVertShaderSrc;
 extern const char* const hdrFragShaderSrc;
 extern const char* const skyFromSpaceVertShaderSrc;
@@ -10,6 +14,25 @@ extern const char* const planetVertShaderSrc;
 extern const char* const planetFragShaderSrc;
 extern const char* const terrainShaderSrc;
 extern const char* const terrain2ShaderSrc;
+extern const char* const heightQueryShaderSrc;
+extern const char* const minMaxShaderSrc;
+extern const char* const terrainRangeShaderSrc;
+extern const char* const erosionShaderSrc;
+extern const char* const instanceCullShaderSrc;
+
+// terrain.comp with the shape and basis of a preset defined after its #version
+std::string terrainShaderSource(NoisePreset const& preset);
+
+// planet.vert and skyfromspace.vert, indexing the planets by gl_DrawIDARB if
+// drawParameters is set, or by a uniform otherwise
+std::string planetVertShaderSource(bool drawParameters);
+std::string skyFromSpaceVertShaderSource(bool drawParameters);
+
+// the most erosion iterations the halo read around each tile allows
+constexpr int maxErosionIterations = 6;
+
+// erosion.comp with MAX_ITERATIONS defined after its #version
+std::string erosionShaderSource();
 }
 
 #endif // SHADERS_H
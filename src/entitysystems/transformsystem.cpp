@@ -0,0 +1,70 @@
+#include "transformsystem.h"
+#include "components.h"
+#include "ecsengine.h"
+
+#include <cmath>
+
+namespace ou {
+
+// kept out of line so the pointers stay restrict and the loop vectorizes
+__attribute__((noinline)) static void transformKernel(std::size_t count,
+    std::int64_t const* __restrict voxelX, std::int64_t const* __restrict voxelY, std::int64_t const* __restrict voxelZ,
+    std::int64_t const* __restrict posX, std::int64_t const* __restrict posY, std::int64_t const* __restrict posZ,
+    double const* __restrict cosAngle, double const* __restrict sinAngle,
+    std::uint8_t* __restrict far,
+    double* __restrict eyeX, double* __restrict eyeY, double* __restrict eyeZ)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        far[i] = (voxelX[i] | voxelY[i] | voxelZ[i]) != 0;
+
+        double x = static_cast<double>(posX[i]);
+        double y = static_cast<double>(posY[i]);
+        double z = static_cast<double>(posZ[i]);
+        // the camera is at minus the planet's offset, rotated into its frame
+        eyeX[i] = -(cosAngle[i] * x + sinAngle[i] * y);
+        eyeY[i] = sinAngle[i] * x - cosAngle[i] * y;
+        eyeZ[i] = -z;
+    }
+}
+
+TransformSystem::TransformSystem()
+{
+}
+
+void TransformSystem::update(ECSEngine& engine, float)
+{
+    SceneComponent const& scene = engine.getOne<SceneComponent>();
+    BodyTransforms& t = engine.getOne<BodyTransforms>();
+
+    std::size_t count = 0;
+    for (Entity& ent : engine.iterate<PlanetComponent>()) {
+        static_cast<void>(ent);
+        ++count;
+    }
+
+    t.positions.resize(count);
+    t.cosAngle.resize(count);
+    t.sinAngle.resize(count);
+    std::size_t i = 0;
+    for (Entity& ent : engine.iterate<PlanetComponent>()) {
+        PlanetComponent& planet = ent.get<PlanetComponent>();
+        planet.transformIndex = i;
+        t.positions.set(i, planet.position);
+        t.cosAngle[i] = std::cos(planet.angle);
+        t.sinAngle[i] = std::sin(planet.angle);
+        ++i;
+    }
+
+    subtract(t.positions, scene.position, t.relative);
+
+    t.far.resize(count);
+    t.eyeX.resize(count);
+    t.eyeY.resize(count);
+    t.eyeZ.resize(count);
+    transformKernel(count,
+        t.relative.voxelX.data(), t.relative.voxelY.data(), t.relative.voxelZ.data(),
+        t.relative.posX.data(), t.relative.posY.data(), t.relative.posZ.data(),
+        t.cosAngle.data(), t.sinAngle.data(),
+        t.far.data(), t.eyeX.data(), t.eyeY.data(), t.eyeZ.data());
+}
+}
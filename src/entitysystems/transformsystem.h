@@ -0,0 +1,18 @@
+#ifndef TRANSFORMSYSTEM_H
+#define TRANSFORMSYSTEM_H
+
+#include "entitysystem.h"
+
+namespace ou {
+
+// converts the positions of all planets to camera relative ones in a single
+// pass, after the camera and planets moved and before rendering
+class TransformSystem : public EntitySystem {
+public:
+    TransformSystem();
+
+    void update(ECSEngine& engine, float deltaTime) override;
+};
+}
+
+#endif // TRANSFORMSYSTEM_H
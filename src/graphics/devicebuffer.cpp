@@ -42,6 +42,11 @@ void DeviceBuffer::setData(RawBufferView data, GLenum usage)
     glNamedBufferData(m_id, data.size(), data.data(), usage);
 }
 
+void DeviceBuffer::allocateImmutable(GLsizeiptr size, GLbitfield flags)
+{
+    glNamedBufferStorage(m_id, size, nullptr, flags);
+}
+
 void DeviceBuffer::use(GLenum target, GLuint index, GLintptr offset, GLsizeiptr size)
 {
     glBindBufferRange(target, index, m_id, offset, size);
@@ -62,6 +67,11 @@ void* DeviceBuffer::map(GLenum access)
     return glMapNamedBuffer(m_id, access);
 }
 
+void* DeviceBuffer::mapRange(GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+    return glMapNamedBufferRange(m_id, offset, length, access);
+}
+
 void DeviceBuffer::unmap()
 {
     glUnmapNamedBuffer(m_id);
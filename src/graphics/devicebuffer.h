@@ -25,11 +25,15 @@ public:
 
     void allocateStorage(GLsizeiptr size, GLenum usage);
     void setData(RawBufferView data, GLenum usage);
+
+    // immutable storage; the buffer can't be resized or respecified after this
+    void allocateImmutable(GLsizeiptr size, GLbitfield flags);
     void use(GLenum target, GLuint index, GLintptr offset, GLsizeiptr size);
     void use(GLenum target, GLuint index);
     void use(GLenum target);
 
     void* map(GLenum access);
+    void* mapRange(GLintptr offset, GLsizeiptr length, GLbitfield access);
     void unmap();
 
     void copyTexture(Texture& tex, GLint level, glm::ivec3 offset,
@@ -0,0 +1,99 @@
+#include "ringbuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ou {
+
+RingBuffer::RingBuffer(GLsizeiptr regionSize)
+    : m_mapped(nullptr)
+    , m_regionSize(0)
+    , m_fences{}
+    , m_region(0)
+    , m_head(0)
+{
+    allocate(regionSize);
+}
+
+RingBuffer::~RingBuffer()
+{
+    releaseFences();
+}
+
+void RingBuffer::allocate(GLsizeiptr regionSize)
+{
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    m_buffer = DeviceBuffer();
+    m_buffer.allocateImmutable(regionSize * regionCount, flags);
+    m_mapped = static_cast<std::uint8_t*>(m_buffer.mapRange(0, regionSize * regionCount, flags));
+    m_regionSize = regionSize;
+    m_region = 0;
+    m_head = 0;
+}
+
+void RingBuffer::releaseFences()
+{
+    for (GLsync& fence : m_fences) {
+        if (fence) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+}
+
+void RingBuffer::beginFrame()
+{
+    m_retired.clear();
+    m_region = (m_region + 1) % regionCount;
+    m_head = 0;
+
+    GLsync& fence = m_fences[m_region];
+    if (fence) {
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+}
+
+void RingBuffer::endFrame()
+{
+    m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+RingBuffer::Range RingBuffer::write(RawBufferView data, GLsizeiptr alignment)
+{
+    const GLsizeiptr size = static_cast<GLsizeiptr>(data.size());
+    GLsizeiptr offset = (m_head + alignment - 1) / alignment * alignment;
+
+    if (offset + size > m_regionSize) {
+        // none of the new buffer's regions are in use yet
+        releaseFences();
+        m_retired.push_back(std::move(m_buffer));
+        allocate(std::max(m_regionSize * 2, size + alignment));
+        offset = 0;
+    }
+
+    GLsizeiptr regionStart = m_region * m_regionSize;
+    std::memcpy(m_mapped + regionStart + offset, data.data(), data.size());
+    m_head = offset + size;
+
+    return { regionStart + offset, size };
+}
+
+void RingBuffer::use(GLenum target, GLuint index, Range const& range)
+{
+    m_buffer.use(target, index, range.offset, range.size);
+}
+
+void RingBuffer::use(GLenum target)
+{
+    m_buffer.use(target);
+}
+
+DeviceBuffer const& RingBuffer::buffer() const
+{
+    return m_buffer;
+}
+}
@@ -0,0 +1,63 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include "devicebuffer.h"
+
+#include <GL/glew.h>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace ou {
+
+// Per-frame data streamed through one persistently mapped buffer, split into
+// a region per frame in flight. Writing waits only for the fence of the frame
+// that last used the region, so the driver never has to reallocate or
+// synchronize. A frame that outgrows its region moves to a buffer twice the
+// size; the old one stays around for the rest of the frame, so ranges bound
+// from it remain valid.
+class RingBuffer {
+public:
+    static constexpr int regionCount = 3;
+
+    struct Range {
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+private:
+    DeviceBuffer m_buffer;
+    std::vector<DeviceBuffer> m_retired;
+    std::uint8_t* m_mapped;
+    GLsizeiptr m_regionSize;
+    std::array<GLsync, regionCount> m_fences;
+    int m_region;
+    GLsizeiptr m_head;
+
+    void allocate(GLsizeiptr regionSize);
+    void releaseFences();
+
+public:
+    RingBuffer(GLsizeiptr regionSize);
+    ~RingBuffer();
+
+    RingBuffer(RingBuffer const&) = delete;
+    RingBuffer& operator=(RingBuffer const&) = delete;
+
+    // call once per frame around all writes
+    void beginFrame();
+    void endFrame();
+
+    // copies data into the current region, with the offset aligned for the
+    // target it will be bound to; bind the range before the next write, as
+    // that may move to a new buffer
+    Range write(RawBufferView data, GLsizeiptr alignment);
+
+    void use(GLenum target, GLuint index, Range const& range);
+    void use(GLenum target);
+
+    DeviceBuffer const& buffer() const;
+};
+}
+
+#endif // RINGBUFFER_H
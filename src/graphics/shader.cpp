@@ -188,6 +188,11 @@ void Shader::setUniform(GLint location, const glm::vec4& vec)
     glProgramUniform4f(m_id, location, vec.x, vec.y, vec.z, vec.w);
 }
 
+void Shader::setUniform(GLint location, const glm::ivec4& vec)
+{
+    glProgramUniform4i(m_id, location, vec.x, vec.y, vec.z, vec.w);
+}
+
 void Shader::setUniform(GLint location, const glm::mat4& mat)
 {
     glProgramUniformMatrix4fv(m_id, location, 1, GL_FALSE, glm::value_ptr(mat));
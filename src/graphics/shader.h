@@ -27,6 +27,7 @@ public:
     void setUniform(GLint location, glm::vec2 const& vec);
     void setUniform(GLint location, glm::vec3 const& vec);
     void setUniform(GLint location, glm::vec4 const& vec);
+    void setUniform(GLint location, glm::ivec4 const& vec);
     void setUniform(GLint location, glm::mat4 const& mat);
 
     void use() const;
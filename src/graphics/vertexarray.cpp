@@ -44,6 +44,11 @@ VertexArray::BufferBinding VertexArray::getBinding(GLuint bindingindex)
     return BufferBinding(this, bindingindex);
 }
 
+void VertexArray::bindElementBuffer(DeviceBuffer const& buf)
+{
+    glVertexArrayElementBuffer(m_id, buf.id());
+}
+
 void VertexArray::use() const
 {
     glBindVertexArray(m_id);
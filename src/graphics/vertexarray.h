@@ -51,6 +51,7 @@ public:
 
     Attribute enableVertexAttrib(GLuint attribindex);
     BufferBinding getBinding(GLuint bindingindex);
+    void bindElementBuffer(DeviceBuffer const& buf);
 
     void use() const;
 
@@ -0,0 +1,42 @@
+#include "heightquery.h"
+
+#include <utility>
+
+namespace ou {
+
+HeightQueries::Ticket HeightQueries::submit(std::vector<glm::dvec3> directions)
+{
+    Batch batch;
+    batch.ticket = m_nextTicket++;
+    batch.directions = std::move(directions);
+    m_pending.push_back(std::move(batch));
+    return m_pending.back().ticket;
+}
+
+bool HeightQueries::poll(Ticket ticket, std::vector<std::int64_t>& heights)
+{
+    auto it = m_resolved.find(ticket);
+    if (it == m_resolved.end()) {
+        return false;
+    }
+
+    heights = std::move(it->second);
+    m_resolved.erase(it);
+    return true;
+}
+
+std::size_t HeightQueries::pendingCount() const
+{
+    return m_pending.size();
+}
+
+std::vector<HeightQueries::Batch> HeightQueries::takePending()
+{
+    return std::exchange(m_pending, {});
+}
+
+void HeightQueries::resolve(Batch&& batch)
+{
+    m_resolved[batch.ticket] = std::move(batch.heights);
+}
+}
@@ -0,0 +1,50 @@
+#ifndef HEIGHTQUERY_H
+#define HEIGHTQUERY_H
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+namespace ou {
+
+// Asynchronous terrain height lookups on a single planet.
+// Any system can submit a batch of directions and poll for the heights in a
+// later frame. The render system serves them from its texel cache or from a
+// batched GPU readback, and falls back to the CPU noise when the planet has
+// no terrain textures.
+class HeightQueries {
+public:
+    using Ticket = std::uint64_t;
+
+    struct Batch {
+        Ticket ticket;
+
+        // from the planet center, in the planet's rotating frame
+        std::vector<glm::dvec3> directions;
+
+        // terrain height above the radius, in millimeters
+        std::vector<std::int64_t> heights;
+    };
+
+    // queue a batch of directions and return the ticket of its results
+    Ticket submit(std::vector<glm::dvec3> directions);
+
+    // move the heights of a resolved batch into heights and forget the ticket;
+    // returns false while the batch is pending
+    bool poll(Ticket ticket, std::vector<std::int64_t>& heights);
+
+    std::size_t pendingCount() const;
+
+    // used by the serving side
+    std::vector<Batch> takePending();
+    void resolve(Batch&& batch);
+
+private:
+    Ticket m_nextTicket = 1;
+    std::vector<Batch> m_pending;
+    std::unordered_map<Ticket, std::vector<std::int64_t>> m_resolved;
+};
+}
+
+#endif // HEIGHTQUERY_H
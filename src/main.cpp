@@ -159,7 +159,8 @@ int main(int argc, char* argv[])
     glDebugMessageCallback(ou::Callbacks::openglDebugCallback, nullptr);
 
     try {
-        ou::Scene scene;
+        // an optional body catalog to stream planets from
+        ou::Scene scene(argc > 1 ? argv[1] : "");
         ou::pScene = &scene;
 
         // enter GLUT event processing cycle
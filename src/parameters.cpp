@@ -21,11 +21,25 @@ Parameters::Parameters()
 #endif
     , anglePerPixel(0.5)
     , terrainTextureSize(1024)
+    , compressTerrainTextures(false)
     , playerHeight(1000)
     , maxRenderLods(15)
+    , quadtreeLod(false)
+    , lodPixelError(2.0)
+    , morphBand(0.25)
     , msaaSamples(1)
     , numPbos(4)
-    , terrainTextureCount(maxLods + 6)
+    , heightCacheSize(1 << 16)
+    , minMaxReadbackSize(64)
+    , terrainGenerationBudget(2.0)
+    , prefetchFrames(30)
+    , prefetchLayers(8)
+    , terrainTextureCount(maxLods + 6 + prefetchLayers)
+    , terrainErosion(false)
+    , erosionIterations(6)
+    , catalogLoadRadius(1)
+    , catalogHysteresis(1)
+    , catalogBodyBudget(10000)
     , rUnit(6371000000000)
     , numLats(10)
     , numLons(10)
@@ -16,11 +16,25 @@ struct Parameters {
     bool renderWireframe;
     double anglePerPixel;
     int terrainTextureSize;
+    bool compressTerrainTextures;
     int playerHeight;
     int maxRenderLods;
+    bool quadtreeLod;
+    double lodPixelError;
+    double morphBand;
     int msaaSamples;
     int numPbos;
+    int heightCacheSize;
+    int minMaxReadbackSize;
+    double terrainGenerationBudget;
+    int prefetchFrames;
+    int prefetchLayers;
     int terrainTextureCount;
+    bool terrainErosion;
+    int erosionIterations;
+    int catalogLoadRadius;
+    int catalogHysteresis;
+    int catalogBodyBudget;
     std::int64_t rUnit;
     int numLats, numLons;
 };
@@ -1,5 +1,8 @@
 #include "planetmath.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace ou {
 
 glm::i64vec2 eucmod(glm::i64vec2 a, std::int64_t base)
@@ -29,50 +32,139 @@ glm::dvec3 applySide(glm::dvec3 const& cube, int side)
     return {};
 }
 
-CubeCoords cubizePoint(glm::dvec3 const& pos)
+glm::dvec3 spherizePoint(glm::dvec2 const& cube, int side)
+{
+    glm::dvec3 p = applySide(glm::dvec3(cube, 1.0), side);
+    glm::dvec3 sq = p * p;
+    return {
+        p.x * std::sqrt(std::max(1 - sq.y / 2 - sq.z / 2 + sq.y * sq.z / 3, 0.0)),
+        p.y * std::sqrt(std::max(1 - sq.z / 2 - sq.x / 2 + sq.z * sq.x / 3, 0.0)),
+        p.z * std::sqrt(std::max(1 - sq.x / 2 - sq.y / 2 + sq.x * sq.y / 3, 0.0))
+    };
+}
+
+// the face a point on the unit sphere lies on, and its two other components
+// oriented as that face's coordinates; points on an edge go to the x faces,
+// then the y ones
+static int selectFace(glm::dvec3 const& pos, glm::dvec2& cube)
 {
-    int side;
     glm::dvec3 absPos = glm::abs(pos);
-    glm::dvec2 cube;
-    if (absPos.x > absPos.y && absPos.x > absPos.z) {
+    if (absPos.x >= absPos.y && absPos.x >= absPos.z) {
         if (pos.x > 0) {
-            side = 0;
             cube = { pos.y, pos.z };
-        } else {
-            side = 1;
-            cube = { -pos.y, pos.z };
+            return 0;
         }
-    } else if (absPos.y > absPos.x && absPos.y > absPos.z) {
+        cube = { -pos.y, pos.z };
+        return 1;
+    } else if (absPos.y >= absPos.z) {
         if (pos.y > 0) {
-            side = 2;
             cube = { pos.z, pos.x };
-        } else {
-            side = 3;
-            cube = { -pos.z, pos.x };
-        }
-    } else {
-        if (pos.z > 0) {
-            side = 4;
-            cube = { pos.x, pos.y };
-        } else {
-            side = 5;
-            cube = { -pos.x, pos.y };
+            return 2;
         }
+        cube = { -pos.z, pos.x };
+        return 3;
+    }
+    if (pos.z > 0) {
+        cube = { pos.x, pos.y };
+        return 4;
     }
+    cube = { -pos.x, pos.y };
+    return 5;
+}
 
-    const auto sq = cube * cube;
-    const double t0 = 2.0 * sq.y - 2.0 * sq.x - 3.0;
-    const double u0 = std::sqrt(glm::max(t0 * t0 - 24.0 * sq.x, 0.0));
-    const double v0 = 2.0 * sq.x - 2.0 * sq.y;
+// magnitude of the cube coordinate whose sphere component squared is sqa,
+// sqb being the other one's
+static double cubeComponent(double sqa, double sqb)
+{
+    const double t = 2.0 * sqa - 2.0 * sqb - 3.0;
+    const double u = std::sqrt(glm::max(t * t - 24.0 * sqb, 0.0));
+    const double v = 2.0 * sqb - 2.0 * sqa;
+    return std::sqrt(glm::max((3.0 - (u + v)) / 2.0, 0.0));
+}
 
-    const double t1 = 2.0 * sq.x - 2.0 * sq.y - 3.0;
-    const double u1 = std::sqrt(glm::max(t1 * t1 - 24.0 * sq.y, 0.0));
-    const double v1 = 2.0 * sq.y - 2.0 * sq.x;
-    cube = glm::sqrt(glm::max((3.0 - glm::dvec2(u1 + v1, u0 + v0)) / 2.0, 0.0)) * glm::sign(cube);
+CubeCoords cubizePoint(glm::dvec3 const& pos)
+{
+    glm::dvec2 cube;
+    int side = selectFace(pos, cube);
+
+    const auto sq = cube * cube;
+    cube = glm::dvec2(cubeComponent(sq.x, sq.y), cubeComponent(sq.y, sq.x)) * glm::sign(cube);
 
     return { cube, side };
 }
 
+// The tables are indexed by the gnomonic coordinates of the point, its two
+// other components divided by the face's one, which cover the whole face
+// as [-1, 1] on each axis. The magnitudes of cube coordinates only depend
+// on those of the gnomonic ones, so a table over one quadrant serves the
+// whole of every face.
+static double gnomonicCubeComponent(double s, double t)
+{
+    const double norm = 1.0 + s * s + t * t;
+    return cubeComponent(s * s / norm, t * t / norm);
+}
+
+CubizeTable::CubizeTable(int resolution)
+    : m_resolution(resolution)
+    , m_values(2 * (resolution + 1) * (resolution + 1))
+{
+    // both components of each node, so a point needs a single cell
+    for (int j = 0; j <= resolution; ++j) {
+        for (int i = 0; i <= resolution; ++i) {
+            double s = double(i) / resolution, t = double(j) / resolution;
+            float* node = &m_values[2 * (j * (resolution + 1) + i)];
+            node[0] = static_cast<float>(gnomonicCubeComponent(s, t));
+            node[1] = static_cast<float>(gnomonicCubeComponent(t, s));
+        }
+    }
+
+    const int samples = resolution * 8;
+    for (int j = 0; j <= samples; ++j) {
+        for (int i = 0; i <= samples; ++i) {
+            double s = double(i) / samples, t = double(j) / samples;
+            glm::dvec2 error = glm::abs(lookup(s, t)
+                - glm::dvec2(gnomonicCubeComponent(s, t), gnomonicCubeComponent(t, s)));
+            m_maxError = std::max(m_maxError, std::max(error.x, error.y));
+        }
+    }
+}
+
+glm::dvec2 CubizeTable::lookup(double s, double t) const
+{
+    const int n = m_resolution;
+    const double x = std::min(s * n, double(n));
+    const double y = std::min(t * n, double(n));
+    const int i = std::min(int(x), n - 1);
+    const int j = std::min(int(y), n - 1);
+    const double fx = x - i, fy = y - j;
+
+    float const* bottom = &m_values[2 * (j * (n + 1) + i)];
+    float const* top = bottom + 2 * (n + 1);
+    glm::dvec2 result;
+    for (int k = 0; k < 2; ++k) {
+        double b = bottom[k] + (bottom[k + 2] - bottom[k]) * fx;
+        double u = top[k] + (top[k + 2] - top[k]) * fx;
+        result[k] = b + (u - b) * fy;
+    }
+    return result;
+}
+
+CubeCoords CubizeTable::cubize(glm::dvec3 const& pos) const
+{
+    glm::dvec2 cube;
+    int side = selectFace(pos, cube);
+
+    // the face's component is the largest one
+    const double major = 1.0 / std::max(std::abs(pos.x), std::max(std::abs(pos.y), std::abs(pos.z)));
+    glm::dvec2 mag = lookup(std::abs(cube.x) * major, std::abs(cube.y) * major);
+    return { { std::copysign(mag.x, cube.x), std::copysign(mag.y, cube.y) }, side };
+}
+
+double CubizeTable::maxError() const
+{
+    return m_maxError;
+}
+
 FirstOrderDerivatives derivatives(glm::dvec2 pos, int side)
 {
     glm::dvec2 sq = pos * pos;
@@ -113,4 +205,154 @@ SecondOrderDerivatives curvature(glm::dvec2 pos, int side)
 
     return { applySide(fxx, side), applySide(fxy, side), applySide(fyy, side) };
 }
+
+void DVec3Array::resize(std::size_t count)
+{
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+}
+
+std::size_t DVec3Array::size() const
+{
+    return x.size();
+}
+
+void CubeCoordsArray::resize(std::size_t count)
+{
+    x.resize(count);
+    y.resize(count);
+    side.resize(count);
+}
+
+std::size_t CubeCoordsArray::size() const
+{
+    return x.size();
+}
+
+// applySide without branches: the side's axis weighs each permutation by 0
+// or 1, and odd sides flip the two components applySide negates
+static inline void applySide(int side, double cx, double cy, double cz,
+    double& outX, double& outY, double& outZ)
+{
+    const double a0 = side < 2 ? 1.0 : 0.0;
+    const double a1 = side == 2 || side == 3 ? 1.0 : 0.0;
+    const double a2 = side > 3 ? 1.0 : 0.0;
+    const double sign = 1.0 - 2.0 * (side & 1);
+    outX = a0 * sign * cz + a1 * cy + a2 * sign * cx;
+    outY = a0 * sign * cx + a1 * sign * cz + a2 * cy;
+    outZ = a0 * cy + a1 * sign * cx + a2 * sign * cz;
+}
+
+// The loops take their arrays as restrict parameters, which is what lets the
+// compiler assume they do not overlap; inlining them into the callers would
+// lose that.
+__attribute__((noinline)) static void cubizeKernel(std::size_t count,
+    double const* __restrict px, double const* __restrict py, double const* __restrict pz,
+    double* __restrict cx, double* __restrict cy, int* __restrict sides)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        const double x = px[i], y = py[i], z = pz[i];
+        const double ax = std::abs(x), ay = std::abs(y), az = std::abs(z);
+
+        // same ties as cubizePoint: x, then y, and z otherwise; the axis
+        // weighs each candidate by 0 or 1 instead of branching
+        const int onX = (ax >= ay) & (ax >= az);
+        const int onY = (1 - onX) & (ay >= az);
+        const int onZ = 1 - onX - onY;
+        const double wx = onX, wy = onY, wz = onZ;
+        const int negative = (wx * x + wy * y + wz * z) <= 0;
+
+        sides[i] = 2 * onY + 4 * onZ + negative;
+        const double u = (wx * y + wy * z + wz * x) * (1.0 - 2.0 * negative);
+        const double v = wx * z + wy * x + wz * y;
+
+        const double sqx = u * u, sqy = v * v;
+        const double t0 = 2.0 * sqy - 2.0 * sqx - 3.0;
+        const double u0 = std::sqrt(std::max(t0 * t0 - 24.0 * sqx, 0.0));
+        const double v0 = 2.0 * sqx - 2.0 * sqy;
+
+        const double t1 = 2.0 * sqx - 2.0 * sqy - 3.0;
+        const double u1 = std::sqrt(std::max(t1 * t1 - 24.0 * sqy, 0.0));
+        const double v1 = 2.0 * sqy - 2.0 * sqx;
+
+        cx[i] = std::copysign(std::sqrt(std::max((3.0 - (u1 + v1)) / 2.0, 0.0)), u);
+        cy[i] = std::copysign(std::sqrt(std::max((3.0 - (u0 + v0)) / 2.0, 0.0)), v);
+    }
+}
+
+__attribute__((noinline)) static void derivativesKernel(std::size_t count,
+    double const* __restrict cx, double const* __restrict cy, int const* __restrict sides,
+    double* __restrict fxX, double* __restrict fxY, double* __restrict fxZ,
+    double* __restrict fyX, double* __restrict fyY, double* __restrict fyZ)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        const double x = cx[i], y = cy[i];
+        const double sqx = x * x, sqy = y * y;
+        const double tx = std::sqrt(.5 - sqx / 6.0);
+        const double ty = std::sqrt(.5 - sqy / 6.0);
+        const double tt = std::sqrt(1.0 - sqx / 2.0 - sqy / 2.0 + sqx * sqy / 3.0);
+
+        applySide(sides[i], ty, -x * y / (6.0 * tx), (-x + 2.0 * x * sqy / 3.0) / (2.0 * tt),
+            fxX[i], fxY[i], fxZ[i]);
+        applySide(sides[i], -x * y / (6.0 * ty), tx, (-y + 2.0 * sqx * y / 3.0) / (2.0 * tt),
+            fyX[i], fyY[i], fyZ[i]);
+    }
+}
+
+__attribute__((noinline)) static void curvatureKernel(std::size_t count,
+    double const* __restrict cx, double const* __restrict cy, int const* __restrict sides,
+    double* __restrict fxxX, double* __restrict fxxY, double* __restrict fxxZ,
+    double* __restrict fxyX, double* __restrict fxyY, double* __restrict fxyZ,
+    double* __restrict fyyX, double* __restrict fyyY, double* __restrict fyyZ)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        const double x = cx[i], y = cy[i];
+        const double sqx = x * x, sqy = y * y;
+        const double tx = std::sqrt(.5 - sqx / 6.0);
+        const double ty = std::sqrt(.5 - sqy / 6.0);
+        const double tt2 = 1.0 - sqx / 2.0 - sqy / 2.0 + sqx * sqy / 3.0;
+        const double tt = std::sqrt(tt2);
+        const double tt3 = tt2 * tt;
+        const double t0 = -x + 2 * x * sqy / 3.0;
+        const double t1 = -y + 2 * y * sqx / 3.0;
+
+        applySide(sides[i], 0,
+            -sqx * y / 36.0 * tx * tx * tx - y / (6.0 * tx),
+            -t0 * t0 / (4.0 * tt3) + (-1.0 + 2.0 * sqy / 3.0) / (2.0 * tt),
+            fxxX[i], fxxY[i], fxxZ[i]);
+        applySide(sides[i], -y / (6.0 * ty), -x / (6.0 * tx),
+            -(y + 2.0 * sqx * y / 3.0) * (x + 2.0 * sqy * x / 3.0) / (4.0 * tt3) + 2.0 * x * y / (3.0 * tt),
+            fxyX[i], fxyY[i], fxyZ[i]);
+        applySide(sides[i], -sqy * x / 36.0 * ty * ty * ty - x / (6.0 * ty), 0,
+            -t1 * t1 / (4.0 * tt3) + (-1.0 + 2.0 * sqx / 3.0) / (2.0 * tt),
+            fyyX[i], fyyY[i], fyyZ[i]);
+    }
+}
+
+void cubizePoints(DVec3Array const& pos, CubeCoordsArray& coords)
+{
+    coords.resize(pos.size());
+    cubizeKernel(pos.size(), pos.x.data(), pos.y.data(), pos.z.data(),
+        coords.x.data(), coords.y.data(), coords.side.data());
+}
+
+void derivatives(CubeCoordsArray const& coords, DVec3Array& fx, DVec3Array& fy)
+{
+    fx.resize(coords.size());
+    fy.resize(coords.size());
+    derivativesKernel(coords.size(), coords.x.data(), coords.y.data(), coords.side.data(),
+        fx.x.data(), fx.y.data(), fx.z.data(), fy.x.data(), fy.y.data(), fy.z.data());
+}
+
+void curvature(CubeCoordsArray const& coords, DVec3Array& fxx, DVec3Array& fxy, DVec3Array& fyy)
+{
+    fxx.resize(coords.size());
+    fxy.resize(coords.size());
+    fyy.resize(coords.size());
+    curvatureKernel(coords.size(), coords.x.data(), coords.y.data(), coords.side.data(),
+        fxx.x.data(), fxx.y.data(), fxx.z.data(),
+        fxy.x.data(), fxy.y.data(), fxy.z.data(),
+        fyy.x.data(), fyy.y.data(), fyy.z.data());
+}
 }
@@ -2,6 +2,7 @@
 #define PLANETMATH_H
 
 #include <glm/glm.hpp>
+#include <vector>
 
 namespace ou {
 
@@ -14,6 +15,32 @@ struct CubeCoords {
 };
 CubeCoords cubizePoint(glm::dvec3 const& pos);
 
+// inverse of cubizePoint, the point on the unit sphere
+glm::dvec3 spherizePoint(glm::dvec2 const& cube, int side);
+
+// Table-driven cubizePoint for callers that only need the face and an
+// approximate position, like bucketing and culling. The face is exact and
+// pos is bilinearly interpolated from the exact mapping, sampled at
+// resolution + 1 points along each half face, to within maxError() of
+// cubizePoint: about 6.5e-4 at resolution 16, 4e-5 at 64 and 2.6e-6 at
+// 256, shrinking with the square of the resolution.
+class CubizeTable {
+public:
+    explicit CubizeTable(int resolution = 64);
+
+    CubeCoords cubize(glm::dvec3 const& pos) const;
+
+    // largest difference to cubizePoint over a sampling eight times finer than the table
+    double maxError() const;
+
+private:
+    glm::dvec2 lookup(double s, double t) const;
+
+    int m_resolution;
+    std::vector<float> m_values;
+    double m_maxError = 0.0;
+};
+
 struct FirstOrderDerivatives {
     glm::dvec3 fx, fy;
 };
@@ -23,6 +50,27 @@ struct SecondOrderDerivatives {
     glm::dvec3 fxx, fxy, fyy;
 };
 SecondOrderDerivatives curvature(glm::dvec2 pos, int side);
+
+// Struct-of-arrays versions of the above for mapping many points at once.
+// The side is selected without branches, so the loops vectorize.
+struct DVec3Array {
+    std::vector<double> x, y, z;
+
+    void resize(std::size_t count);
+    std::size_t size() const;
+};
+
+struct CubeCoordsArray {
+    std::vector<double> x, y;
+    std::vector<int> side;
+
+    void resize(std::size_t count);
+    std::size_t size() const;
+};
+
+void cubizePoints(DVec3Array const& pos, CubeCoordsArray& coords);
+void derivatives(CubeCoordsArray const& coords, DVec3Array& fx, DVec3Array& fy);
+void curvature(CubeCoordsArray const& coords, DVec3Array& fxx, DVec3Array& fxy, DVec3Array& fyy);
 }
 
 #endif // PLANETMATH_H
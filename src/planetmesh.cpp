@@ -0,0 +1,90 @@
+#include "planetmesh.h"
+
+#include <algorithm>
+#include <deque>
+
+namespace ou {
+
+PlanetMesh buildPlanetMesh(int gridSize, int stripWidth)
+{
+    const int n = gridSize;
+    auto gridIndex = [&](int x, int y) { return static_cast<std::uint32_t>(y * (n + 1) + x); };
+
+    std::vector<glm::vec3> vertices;
+    for (int y = 0; y <= n; ++y) {
+        for (int x = 0; x <= n; ++x) {
+            vertices.push_back({ x, y, 0 });
+        }
+    }
+
+    std::vector<std::uint32_t> indices;
+    for (int x0 = 0; x0 < n; x0 += stripWidth) {
+        for (int y = 0; y < n; ++y) {
+            for (int x = x0; x < std::min(x0 + stripWidth, n); ++x) {
+                indices.insert(indices.end(), { gridIndex(x, y), gridIndex(x + 1, y), gridIndex(x + 1, y + 1) });
+                indices.insert(indices.end(), { gridIndex(x, y), gridIndex(x + 1, y + 1), gridIndex(x, y + 1) });
+            }
+        }
+    }
+
+    // skirts, walking around the edge with the bottom vertex of each
+    // corner of the walk shared by both sides
+    std::vector<glm::ivec2> perimeter;
+    for (int i = 0; i < n; ++i) {
+        perimeter.push_back({ i, 0 });
+    }
+    for (int i = 0; i < n; ++i) {
+        perimeter.push_back({ n, i });
+    }
+    for (int i = n; i > 0; --i) {
+        perimeter.push_back({ i, n });
+    }
+    for (int i = n; i > 0; --i) {
+        perimeter.push_back({ 0, i });
+    }
+
+    std::vector<std::uint32_t> bottom;
+    for (glm::ivec2 const& p : perimeter) {
+        bottom.push_back(static_cast<std::uint32_t>(vertices.size()));
+        vertices.push_back({ p.x, p.y, 1 });
+    }
+    for (std::size_t i = 0; i < perimeter.size(); ++i) {
+        std::size_t j = (i + 1) % perimeter.size();
+        std::uint32_t a = gridIndex(perimeter[i].x, perimeter[i].y);
+        std::uint32_t b = gridIndex(perimeter[j].x, perimeter[j].y);
+        std::uint32_t aDown = bottom[i], bDown = bottom[j];
+        indices.insert(indices.end(), { a, aDown, bDown, a, bDown, b, a, bDown, aDown, a, b, bDown });
+    }
+
+    // store the vertices in the order they are first used
+    std::vector<std::uint32_t> remap(vertices.size(), ~0u);
+    PlanetMesh mesh;
+    for (std::uint32_t& index : indices) {
+        if (remap[index] == ~0u) {
+            remap[index] = static_cast<std::uint32_t>(mesh.vertices.size());
+            glm::vec3 v = vertices[index];
+            mesh.vertices.push_back(glm::vec3(glm::vec2(v) / float(n) * 2.f - 1.f, v.z));
+        }
+        index = remap[index];
+    }
+    mesh.indices = std::move(indices);
+    return mesh;
+}
+
+double averageCacheMissRatio(std::vector<std::uint32_t> const& indices, int cacheSize)
+{
+    std::deque<std::uint32_t> cache;
+    std::size_t misses = 0;
+    for (std::uint32_t index : indices) {
+        if (std::find(cache.begin(), cache.end(), index) != cache.end()) {
+            continue;
+        }
+        ++misses;
+        cache.push_back(index);
+        if (int(cache.size()) > cacheSize) {
+            cache.pop_front();
+        }
+    }
+    return indices.empty() ? 0.0 : double(misses) / (indices.size() / 3);
+}
+}
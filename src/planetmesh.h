@@ -0,0 +1,30 @@
+#ifndef PLANETMESH_H
+#define PLANETMESH_H
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace ou {
+
+// The grid every planet instance is drawn with: gridSize * gridSize cells
+// over [-1, 1]^2, with double-sided skirts hanging from its four edges;
+// z is 1 for the bottom of the skirt. Indexed triangles, with the cells
+// visited in strips stripWidth cells wide, row by row, so that a row's
+// vertices are still in the post-transform cache for the next row, and the
+// vertices stored in order of first use. Every cell keeps the diagonal from
+// its lower to its upper corner, which the geomorphing relies on. Strips
+// of 6 cells keep the misses near one vertex per two triangles for caches
+// of 16 entries and up.
+struct PlanetMesh {
+    std::vector<glm::vec3> vertices;
+    std::vector<std::uint32_t> indices;
+};
+
+PlanetMesh buildPlanetMesh(int gridSize, int stripWidth = 6);
+
+// vertices shaded per triangle with a FIFO post-transform cache of cacheSize
+double averageCacheMissRatio(std::vector<std::uint32_t> const& indices, int cacheSize);
+}
+
+#endif // PLANETMESH_H
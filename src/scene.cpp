@@ -7,9 +7,11 @@
 #include "parameters.h"
 
 #include "entitysystems/camerasystem.h"
+#include "entitysystems/catalogsystem.h"
 #include "entitysystems/inputsystem.h"
 #include "entitysystems/planetsystem.h"
 #include "entitysystems/rendersystem.h"
+#include "entitysystems/transformsystem.h"
 
 #include <GL/freeglut.h>
 #include <iostream>
@@ -30,7 +32,7 @@ void Scene::reshapeWindow(int width, int height)
     scene.windowResized = true;
 }
 
-Scene::Scene()
+Scene::Scene(std::string const& catalogPath)
     : m_lastFrameTime(std::chrono::system_clock::now())
     , m_queries(4)
 {
@@ -43,23 +45,28 @@ Scene::Scene()
     // scene entity
     SceneComponent scene;
     scene.position = { { 0, 0, 0 }, eye };
-    m_engine.addEntity(Entity({ scene, Input{}, Parameters{} }));
+    m_engine.addEntity(Entity({ scene, Input{}, Parameters{}, BodyTransforms{} }));
 
     // planets
-    PlanetComponent planet1;
-    planet1.position = VoxelCoords{ { 0, 0, 0 }, eye + glm::i64vec3(0, 0, -40371000000000) };
-    planet1.radius = 6371000000000;
-    planet1.terrainFactor = 0.001;
-    m_engine.addEntity(Entity({ planet1 }));
-
-    PlanetComponent planet2;
-    planet2.position = VoxelCoords{ { 0, 0, 0 }, eye + glm::i64vec3(6371000000000 + 7000000000000, 0, -40371000000000) };
-    planet2.radius = 4000000000000;
-    //m_engine.addEntity(Entity({ planet2 }));
+    if (!catalogPath.empty()) {
+        m_engine.addSystem(std::make_unique<CatalogSystem>(catalogPath), 2);
+    } else {
+        PlanetComponent planet1;
+        planet1.position = VoxelCoords{ { 0, 0, 0 }, eye + glm::i64vec3(0, 0, -40371000000000) };
+        planet1.radius = 6371000000000;
+        planet1.terrainFactor = 0.001;
+        m_engine.addEntity(Entity({ planet1 }));
+
+        PlanetComponent planet2;
+        planet2.position = VoxelCoords{ { 0, 0, 0 }, eye + glm::i64vec3(6371000000000 + 7000000000000, 0, -40371000000000) };
+        planet2.radius = 4000000000000;
+        //m_engine.addEntity(Entity({ planet2 }));
+    }
 
     m_engine.addSystem(std::make_unique<InputSystem>(), 9);
     m_engine.addSystem(std::make_unique<CameraSystem>(), 1);
     m_engine.addSystem(std::make_unique<PlanetSystem>(), 1);
+    m_engine.addSystem(std::make_unique<TransformSystem>(), 1);
     m_engine.addSystem(std::make_unique<RenderSystem>(m_engine.getOne<Parameters>()), 0);
 }
 
@@ -123,6 +130,19 @@ void Scene::render()
                   << m_totalGpuTime.count() / m_frameCount * 1000.f
                   << "ms / 16ms" << std::endl;
 
+        SceneComponent& scene = m_engine.getOne<SceneComponent>();
+        std::cout << "Terrain Generation Time: "
+                  << scene.terrainGenerationTime / m_frameCount
+                  << "ms, erosion " << scene.terrainErosionTime / m_frameCount
+                  << "ms" << std::endl;
+        std::cout << "Terrain Instances: " << scene.drawnInstances / m_frameCount
+                  << " drawn, " << scene.culledInstances / m_frameCount
+                  << " culled" << std::endl;
+
+        scene.terrainGenerationTime = 0.0;
+        scene.terrainErosionTime = 0.0;
+        scene.drawnInstances = 0;
+        scene.culledInstances = 0;
         m_totalWorkTime = 0s;
         m_totalGpuTime = 0s;
         m_frameCount = 0;
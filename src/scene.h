@@ -4,6 +4,7 @@
 #include <chrono>
 #include <glm/glm.hpp>
 #include <memory>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -27,7 +28,8 @@ class Scene {
     CircularBuffer<GLQuery> m_queries;
 
 public:
-    Scene();
+    // planets are paged in from the body catalog at catalogPath, if given
+    explicit Scene(std::string const& catalogPath = {});
     ~Scene();
     void render();
 
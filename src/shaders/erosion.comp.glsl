@@ -0,0 +1,167 @@
+R"GLSL(
+#version 430
+#define TILE 32
+
+// one iteration moves water and sediment by a texel, so the result within a
+// tile only depends on the texels up to this far around it; MAX_ITERATIONS
+// is defined by the application
+#define HALO (MAX_ITERATIONS + 1)
+#define SPAN (TILE + 2 * HALO)
+
+// texels from the window edge over which erosion fades out, so a tile still
+// meets the coarser lod around it
+#define BORDER 32
+
+#define RAIN 0.05
+#define FLOW 0.25
+#define ERODE 0.1
+#define EVAPORATION 0.05
+
+layout(local_size_x = TILE, local_size_y = TILE, local_size_z = 1) in;
+layout(r32f, binding = 0) writeonly uniform image2DArray image;
+layout(r32f, binding = 5) readonly uniform image2DArray source;
+layout(rg16f, binding = 4) uniform image2DArray gradImage;
+
+struct Lod
+{
+    vec2 align;
+    vec2 pDiff;
+    float scale;
+    int imgIdx;
+    int parentIdx;
+    int lod;
+    uvec4 texelOrigin;
+};
+
+layout(std140, binding = 3) uniform LodData
+{
+    Lod uLods[64];
+};
+
+// one item per z: a freshly generated layer and the regions of it that are
+// new, as offset and size wrapping around the layer; layer z of source holds
+// a copy of its heights from before erosion
+struct ErosionItem
+{
+    ivec4 regions[2];
+    int lodIdx;
+    int regionCount;
+};
+
+layout(std430, binding = 7) readonly buffer ErosionItems
+{
+    ErosionItem uItems[];
+};
+
+layout(location = 0) uniform int iterations;
+
+shared float original[SPAN * SPAN];
+shared float height[SPAN * SPAN];
+shared float water[SPAN * SPAN];
+
+bool overlaps(int start, int count, int offset, int extent, int size)
+{
+    return (start - offset + size) % size < extent || (offset - start + size) % size < count;
+}
+
+bool inRegion(ivec2 texel, ivec4 region, ivec2 size)
+{
+    ivec2 d = (texel - region.xy + size) % size;
+    return all(lessThan(d, region.zw));
+}
+
+void main() {
+    ErosionItem item = uItems[gl_WorkGroupID.z];
+    Lod lod = uLods[item.lodIdx];
+    ivec2 size = imageSize(image).xy;
+    ivec2 tileOrigin = ivec2(gl_WorkGroupID.xy) * TILE;
+    if (any(greaterThanEqual(tileOrigin, size))) {
+        return;
+    }
+
+    // only tiles holding new texels, the same for the whole group
+    bool fresh = false;
+    for (int r = 0; r < item.regionCount; ++r) {
+        ivec4 region = item.regions[r];
+        fresh = fresh || (overlaps(tileOrigin.x, TILE, region.x, region.z, size.x)
+                             && overlaps(tileOrigin.y, TILE, region.y, region.w, size.y));
+    }
+    if (!fresh) {
+        return;
+    }
+
+    // the halo comes from the copy, as neighbouring tiles write their eroded
+    // texels into the layer meanwhile
+    int first = int(gl_LocalInvocationIndex);
+    for (int i = first; i < SPAN * SPAN; i += TILE * TILE) {
+        ivec2 texel = (tileOrigin + ivec2(i % SPAN, i / SPAN) - HALO + size) % size;
+        original[i] = imageLoad(source, ivec3(texel, gl_WorkGroupID.z)).r;
+        height[i] = original[i];
+        water[i] = 0.0;
+    }
+    barrier();
+
+    // water rains onto every texel and flows down the surface, carrying off
+    // sediment from the texel it leaves in proportion to its amount and to
+    // the slope; every exchange between two texels conserves both
+    const ivec2 neighbours[4] = ivec2[](ivec2(1, 0), ivec2(-1, 0), ivec2(0, 1), ivec2(0, -1));
+    float rain = pow(lod.scale, 0.8) / 16 * RAIN;
+    for (int it = 0; it < min(iterations, MAX_ITERATIONS); ++it) {
+        float newHeight[(SPAN * SPAN + TILE * TILE - 1) / (TILE * TILE)];
+        float newWater[(SPAN * SPAN + TILE * TILE - 1) / (TILE * TILE)];
+        for (int i = first, k = 0; i < SPAN * SPAN; i += TILE * TILE, ++k) {
+            ivec2 c = ivec2(i % SPAN, i / SPAN);
+            float h = height[i];
+            float w = water[i] + rain;
+            newHeight[k] = h;
+            newWater[k] = w;
+            if (any(equal(c, ivec2(0))) || any(equal(c, ivec2(SPAN - 1)))) {
+                continue;
+            }
+
+            for (int n = 0; n < 4; ++n) {
+                int j = i + neighbours[n].y * SPAN + neighbours[n].x;
+                float hn = height[j];
+                float wn = water[j] + rain;
+                float d = (h + w) - (hn + wn);
+                float flow = d > 0 ? min(FLOW * d, w * .25) : max(FLOW * d, -wn * .25);
+                newHeight[k] -= clamp(ERODE * flow / rain, -.2, .2) * abs(h - hn);
+                newWater[k] -= flow;
+            }
+            newWater[k] *= 1.0 - EVAPORATION;
+        }
+        barrier();
+
+        for (int i = first, k = 0; i < SPAN * SPAN; i += TILE * TILE, ++k) {
+            height[i] = newHeight[k];
+            water[i] = newWater[k];
+        }
+        barrier();
+    }
+
+    // write back the new texels only, fading out toward the window edge
+    ivec2 local = ivec2(gl_LocalInvocationID.xy);
+    ivec2 texel = (tileOrigin + local) % size;
+    bool write = false;
+    for (int r = 0; r < item.regionCount; ++r) {
+        write = write || inRegion(texel, item.regions[r], size);
+    }
+    if (!write) {
+        return;
+    }
+
+    ivec2 windowTexel = (texel - ivec2(round(lod.align * vec2(size))) + size) % size;
+    int edge = min(min(windowTexel.x, windowTexel.y), min(size.x - 1 - windowTexel.x, size.y - 1 - windowTexel.y));
+    float mask = smoothstep(0.0, float(BORDER), float(edge));
+
+    int i = (local.y + HALO) * SPAN + local.x + HALO;
+    float delta = height[i] - original[i];
+    float dx = (height[i + 1] - original[i + 1]) - (height[i - 1] - original[i - 1]);
+    float dy = (height[i + SPAN] - original[i + SPAN]) - (height[i - SPAN] - original[i - SPAN]);
+
+    // central differences across two texels, per local unit spanning N/2 texels
+    vec2 gradient = imageLoad(gradImage, ivec3(texel, lod.imgIdx)).xy + vec2(dx, dy) * (float(size.x) / 4) * mask;
+    imageStore(image, ivec3(texel, lod.imgIdx), vec4(original[i] + delta * mask, 0.0, 0.0, 1.0));
+    imageStore(gradImage, ivec3(texel, lod.imgIdx), vec4(gradient, 0.0, 0.0));
+}
+)GLSL"
@@ -0,0 +1,30 @@
+R"GLSL(
+#version 430
+layout(local_size_x = 64, local_size_y = 1, local_size_z = 1) in;
+layout(binding = 1) uniform sampler2DArray tex;
+layout(rgba32f, binding = 2) uniform image1D bases;
+
+// texel x, y and layer of each query
+layout(std430, binding = 5) readonly buffer Queries {
+    ivec4 uQueries[];
+};
+
+// height, base hi, base lo
+layout(std430, binding = 6) writeonly buffer Results {
+    vec4 uResults[];
+};
+
+layout(location = 0) uniform int count;
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= uint(count)) {
+        return;
+    }
+
+    ivec3 q = uQueries[i].xyz;
+    vec4 base = imageLoad(bases, q.z);
+    float height = texelFetch(tex, q, 0).r * base.z + base.w;
+    uResults[i] = vec4(height, base.xy, 0);
+}
+)GLSL"
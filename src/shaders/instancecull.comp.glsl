@@ -0,0 +1,206 @@
+R"GLSL(
+#version 430
+layout(local_size_x = 64) in;
+
+layout(rgba32f, binding = 2) uniform readonly image1D bases;
+
+// the top of the min/max pyramid, the decoded height range of each layer
+layout(rg32f, binding = 3) uniform readonly image2DArray layerRanges;
+
+struct Planet {
+    mat4 viewProjMat;
+    vec3 xJac;
+    vec3 yJac;
+    vec3 xxCurv;
+    vec3 xyCurv;
+    vec3 yyCurv;
+    vec3 eyeOffset;
+    vec3 lightDir;
+    vec3 eyePos;
+    vec2 origin;
+    vec2 uBase;
+    int playerSide;
+    float terrainFactor;
+    float innerRadius;
+    int gridSize;
+};
+
+layout(std430, binding = 0) readonly buffer Planets {
+    Planet planets[];
+};
+
+// same layout as the vertex attributes
+struct Instance {
+    vec4 discardRegion;
+    vec2 offset;
+    vec2 texAlign;
+    vec2 parentTexAlign;
+    vec2 parentOffset;
+    vec3 node;
+    float scale;
+    float morphBand;
+    int side;
+    int texIdx;
+    int parentTexIdx;
+};
+
+layout(std430, binding = 8) readonly buffer Candidates {
+    Instance candidates[];
+};
+
+layout(std430, binding = 9) writeonly buffer Survivors {
+    Instance survivors[];
+};
+
+// one per planet, along y
+struct Item {
+    uint first;
+    uint count;
+    uint draw;
+    float occluderHeight; // lowest terrain, above the radius
+    float horizonAngle; // negative if the eye is below the occluder
+};
+
+layout(std430, binding = 10) readonly buffer Items {
+    Item items[];
+};
+
+struct Command {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 11) buffer Commands {
+    Command commands[];
+};
+
+layout(std430, binding = 12) buffer Stats {
+    uint tested;
+    uint culled;
+};
+
+vec3 applySide(vec3 cube, int side)
+{
+    switch (side) {
+    case 0:
+        return vec3( cube.z, cube.x, cube.y );
+    case 1:
+        return vec3( -cube.z, -cube.x, cube.y );
+    case 2:
+        return vec3( cube.y, cube.z, cube.x );
+    case 3:
+        return vec3( cube.y, -cube.z, -cube.x );
+    case 4:
+        return vec3( cube.x, cube.y, cube.z );
+    case 5:
+        return vec3( -cube.x, cube.y, -cube.z );
+    }
+}
+
+vec3 spherizePoint(vec2 q, int side)
+{
+    vec3 p = applySide(vec3(q, 1.0), side);
+    vec3 sq = p * p;
+    return vec3(
+        p.x * sqrt(max(1 - sq.y / 2 - sq.z / 2 + sq.y * sq.z / 3, 0.0)),
+        p.y * sqrt(max(1 - sq.z / 2 - sq.x / 2 + sq.z * sq.x / 3, 0.0)),
+        p.z * sqrt(max(1 - sq.x / 2 - sq.y / 2 + sq.x * sq.y / 3, 0.0))
+    );
+}
+
+// accurate for the small angles of fine instances, unlike acos
+float angleBetween(vec3 a, vec3 b)
+{
+    return atan(length(cross(a, b)), dot(a, b));
+}
+
+bool inFrustum(mat4 viewProj, vec3 center, float radius)
+{
+    for (int i = 0; i < 4; ++i) {
+        vec4 plane = vec4(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+        vec4 side = vec4(viewProj[0][i / 2], viewProj[1][i / 2], viewProj[2][i / 2], viewProj[3][i / 2]);
+        plane += (i % 2 == 0) ? side : -side;
+        plane /= length(plane.xyz);
+        if (dot(plane.xyz, center) + plane.w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the height range of a layer above the radius, in rUnit like the rest; the
+// vertex shader draws relative to uBase, but the eye and the occluder are
+// absolute, so the layer's whole base is added here
+vec2 layerHeights(int layer, Planet planet)
+{
+    vec4 data = imageLoad(bases, layer);
+    vec2 range = imageLoad(layerRanges, ivec3(0, 0, layer)).rg;
+    return (range + data.x + data.y) * planet.terrainFactor * planet.innerRadius;
+}
+
+// Frustum and horizon culling of the instances of every planet, the same
+// tests as terrainculling on the CPU, with the terrain bounded by the height
+// range of the instance's whole layer, and of its parent's where it morphs
+// into it. Survivors are appended to the range the planet's draw command
+// starts at.
+void main() {
+    Item item = items[gl_WorkGroupID.y];
+    if (gl_GlobalInvocationID.x >= item.count) {
+        return;
+    }
+    Planet planet = planets[item.draw];
+    Instance inst = candidates[item.first + gl_GlobalInvocationID.x];
+
+    vec2 heights = layerHeights(inst.texIdx, planet);
+    if (inst.morphBand > 0) {
+        vec2 parent = layerHeights(inst.parentTexIdx, planet);
+        heights = vec2(min(heights.x, parent.x), max(heights.y, parent.y));
+    }
+
+    vec2 center = inst.offset + inst.node.xy * inst.scale;
+    if (inst.side == planet.playerSide) {
+        center += planet.origin;
+    }
+    float halfSize = inst.node.z * inst.scale;
+
+    float top = planet.innerRadius + heights.y;
+    float bottom = planet.innerRadius + heights.x;
+    vec3 direction = normalize(spherizePoint(center, inst.side));
+    vec3 lo = vec3(3.4e38), hi = vec3(-3.4e38);
+    float angularRadius = 0.0;
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x) {
+            vec3 dir = spherizePoint(center + vec2(x, y) * halfSize, inst.side);
+            angularRadius = max(angularRadius, angleBetween(dir, direction));
+            lo = min(lo, min(dir * bottom, dir * top));
+            hi = max(hi, max(dir * bottom, dir * top));
+        }
+    }
+
+    // the sagitta of the surface between the samples, and some slack for
+    // subtracting the eye from positions the size of the radius in floats
+    float sagitta = 2 * top * sin(angularRadius * .5) * sin(angularRadius * .5);
+    float radius = length(hi - lo) * .5 + sagitta + top * 1e-6;
+    bool visible = inFrustum(planet.viewProjMat, (lo + hi) * .5 - planet.eyePos, radius);
+
+    if (visible && item.horizonAngle >= 0) {
+        float occluder = planet.innerRadius + item.occluderHeight;
+        float rise = heights.y - item.occluderHeight;
+        float beyond = rise > 0 ? atan(sqrt(rise * (top + occluder)), occluder) : 0.0;
+        float angle = angleBetween(normalize(planet.eyePos), direction);
+        visible = angle - angularRadius < item.horizonAngle + beyond;
+    }
+
+    atomicAdd(tested, 1u);
+    if (!visible) {
+        atomicAdd(culled, 1u);
+        return;
+    }
+
+    uint slot = atomicAdd(commands[item.draw].instanceCount, 1u);
+    survivors[commands[item.draw].baseInstance + slot] = inst;
+}
+)GLSL"
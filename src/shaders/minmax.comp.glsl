@@ -0,0 +1,35 @@
+R"GLSL(
+#version 430
+layout(local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+layout(binding = 1) uniform sampler2DArray tex;
+layout(rgba32f, binding = 2) uniform readonly image1D bases;
+
+// level 0 reduces the heightmap layer, later levels reduce the previous level
+layout(rg32f, binding = 3) uniform readonly image2D srcLevel;
+layout(rg32f, binding = 4) uniform writeonly image2D dstLevel;
+
+layout(location = 0) uniform int level;
+layout(location = 1) uniform int layer;
+
+void main() {
+    ivec2 dst = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(dst, imageSize(dstLevel)))) {
+        return;
+    }
+
+    vec2 encoding = imageLoad(bases, layer).zw;
+
+    vec2 range = vec2(3.4e38, -3.4e38);
+    for (int y = 0; y < 2; ++y) {
+        for (int x = 0; x < 2; ++x) {
+            ivec2 src = dst * 2 + ivec2(x, y);
+            vec2 s = level == 0
+                ? vec2(texelFetch(tex, ivec3(src, layer), 0).r * encoding.x + encoding.y)
+                : imageLoad(srcLevel, src).rg;
+            range = vec2(min(range.x, s.x), max(range.y, s.y));
+        }
+    }
+
+    imageStore(dstLevel, dst, vec4(range, 0, 0));
+}
+)GLSL"
@@ -1,7 +1,7 @@
 R"GLSL(
 #version 430 core
 
-layout(std140, binding = 0) uniform Ubo {
+struct Planet {
     mat4 viewProjMat;
     vec3 xJac;
     vec3 yJac;
@@ -16,36 +16,45 @@ layout(std140, binding = 0) uniform Ubo {
     int playerSide;
     float terrainFactor;
     float innerRadius;
+    int gridSize;
 };
 
+// one entry per planet, indexed by the draw within the multi-draw
+layout(std430, binding = 0) readonly buffer Planets {
+    Planet planets[];
+};
+
+Planet planet;
+
 layout(binding = 1) uniform sampler2DArray tex;
-layout(rg32f, binding = 2) uniform image1D bases;
+layout(rgba32f, binding = 2) uniform image1D bases;
+layout(binding = 4) uniform sampler2DArray gradTex;
 
 in vec2 vUv;
 in vec2 vCube;
+flat in int vPlanet;
 in vec3 vPosition;
 in vec3 vFx, vFy;
 in float vLogz;
 flat in float vScale;
 flat in vec4 vDiscardReg;
 flat in int vTexIdx;
+flat in vec2 vTexAlign;
 
 in vec3 vC0; // atmosphere color
 in vec3 vC1; // attenuation
 
 out vec4 color;
 
-const ivec2 offsets[4] = ivec2[4](ivec2(-1, 0), ivec2(1, 0), ivec2(0, -1), ivec2(0, 1));
-
-vec2 getGradient(vec2 uv, float t, float span) {
-    vec4 h = textureGatherOffsets(tex, vec3(uv, vTexIdx), offsets, 0);
-    h *= terrainFactor;
-
-    const ivec3 size = textureSize(tex, 0);
-    return vec2(h.y - h.x, h.w - h.z) * size.xy / span;
+// gradients are stored per unit of instance-local coordinates,
+// which span vScale units of cube coordinates
+vec2 getGradient(vec2 uv, float span) {
+    return texture(gradTex, vec3(uv, vTexIdx)).xy * planet.terrainFactor / span;
 }
 
 void main() {
+    planet = planets[vPlanet];
+
     // Don't render outside the face
     if (vScale < 1 && (vCube.x < -1 || vCube.y < -1 || vCube.x > 1 || vCube.y > 1)) {
         discard;
@@ -59,14 +68,13 @@ void main() {
     gl_FragDepth = vLogz;
 
     vec2 t = 1 / vec2(textureSize(tex, 0));
-    vec2 uv = (vUv + 1.0) * .5;
-    uv = mix(t * 2.5, 1 - t * 2.5, uv);
-    float height = texture(tex, vec3(uv, vTexIdx)).r;
+    vec2 uv = clamp((vUv + 1.0) * .5, t * .5, 1 - t * .5) + vTexAlign;
     vec4 baseData = imageLoad(bases, vTexIdx);
+    float height = texture(tex, vec3(uv, vTexIdx)).r * baseData.z + baseData.w;
     float base = baseData.r + baseData.g;
-    height = max(0, base + height) * terrainFactor;
+    height = max(0, base + height) * planet.terrainFactor;
 
-    vec2 grad = getGradient(uv, t.x, vScale);
+    vec2 grad = getGradient(uv, vScale);
     vec3 snormal = normalize(cross(vFx, vFy));
     vec3 fx = vFx + snormal * grad.x;
     vec3 fy = vFy + snormal * grad.y;
@@ -76,7 +84,7 @@ void main() {
     vec3 groundColor = mix(vec3(0.3, 0.3, 0.3), vec3(0.1, 0.6, 0.0), 1 - step(slope, 0.9));
     color.xyz = mix(groundColor, vec3(0.0, 0.0, 0.5), step(height, 0.0));
 
-    vec3 lightReflect = normalize(reflect(lightDir, normal));
+    vec3 lightReflect = normalize(reflect(planet.lightDir, normal));
     vec3 vertexToEye = normalize(vPosition);
     float specularFactor = dot(vertexToEye, lightReflect);
     specularFactor = pow(max(0, specularFactor), 40);
@@ -1,7 +1,15 @@
 R"GLSL(
 #version 430 core
-
-layout(std140, binding = 0) uniform Ubo {
+#ifdef DRAW_PARAMETERS
+#extension GL_ARB_shader_draw_parameters : require
+#define DRAW_ID gl_DrawIDARB
+#else
+// drawn one planet at a time, with its index set before each draw
+layout(location = 0) uniform int drawId;
+#define DRAW_ID drawId
+#endif
+
+struct Planet {
     mat4 viewProjMat;
     vec3 xJac;
     vec3 yJac;
@@ -16,13 +24,21 @@ layout(std140, binding = 0) uniform Ubo {
     int playerSide;
     float terrainFactor;
     float innerRadius;
+    int gridSize;
+};
+
+// one entry per planet, indexed by the draw within the multi-draw
+layout(std430, binding = 0) readonly buffer Planets {
+    Planet planets[];
 };
 
+Planet planet;
+
 layout(binding = 1) uniform sampler2DArray tex;
-layout(rg32f, binding = 2) uniform image1D bases;
+layout(rgba32f, binding = 2) uniform image1D bases;
 
 // per-vertex attributes
-layout(location = 0) in vec2 pos;
+layout(location = 0) in vec3 pos; // z is 1 at the bottom of the skirt
 
 // per-instance attributes
 layout(location = 1) in vec2 offset;
@@ -30,15 +46,23 @@ layout(location = 2) in int side;
 layout(location = 3) in float scale;
 layout(location = 4) in vec4 discardRegion;
 layout(location = 5) in int texIdx;
+layout(location = 6) in vec2 texAlign; // where the layer's toroidal storage starts
+layout(location = 7) in vec3 node; // part of the layer drawn, as offset and scale
+layout(location = 8) in float morphBand;
+layout(location = 9) in int parentTexIdx;
+layout(location = 10) in vec2 parentTexAlign;
+layout(location = 11) in vec2 parentOffset; // center in the parent's layer-local coordinates
 
 out vec2 vUv;
 out vec2 vCube;
+flat out int vPlanet;
 out vec3 vPosition;
 out vec3 vFx, vFy;
 out float vLogz;
 flat out float vScale;
 flat out vec4 vDiscardReg;
 flat out int vTexIdx;
+flat out vec2 vTexAlign;
 
 out vec3 vC0; // atmosphere color
 out vec3 vC1; // attenuation
@@ -120,29 +144,56 @@ float ascale(float fCos)
     return scaleDepth * exp(-0.00287 + x*(0.459 + x*(3.83 + x*(-6.80 + x*5.25))));
 }
 
+float layerHeight(vec2 local, int layer, vec2 align)
+{
+    vec2 t = 1 / vec2(textureSize(tex, 0));
+    vec2 uv = clamp((local + 1.0) * .5, t * .5, 1 - t * .5) + align;
+    vec4 layerData = imageLoad(bases, layer);
+    float height = texture(tex, vec3(uv, layer)).r * layerData.z + layerData.w;
+    vec2 baseData = layerData.rg - planet.uBase;
+    return height + baseData.r + baseData.g;
+}
+
 void main() {
-    vUv = pos;
+    vPlanet = DRAW_ID;
+    planet = planets[vPlanet];
+
+    vec2 local = pos.xy * node.z + node.xy;
+
+    // Geomorphing: across the band along the edge, the odd vertices of the
+    // grid slide onto the even ones, which are the vertices of the parent's
+    // grid, so at the edge the mesh and its heights are the parent's
+    float morph = 0.0;
+    if (morphBand > 0) {
+        float edge = max(abs(local.x), abs(local.y));
+        morph = clamp((edge - (1 - morphBand)) / morphBand, 0.0, 1.0);
+        vec2 g = round((local + 1) * .5 * planet.gridSize);
+        vec2 odd = g - 2 * floor(g * .5);
+        local -= odd * morph * 2 / planet.gridSize;
+    }
+    vUv = local;
     vDiscardReg = discardRegion;
     vTexIdx = texIdx;
+    vTexAlign = texAlign;
     vScale = scale;
 
     vec3 normal;
-    if (playerSide == int(side)) {
-        vec2 c = pos * scale + offset;
-        vCube = c + origin;
-
-        vec3 spherized = spherizePoint(vCube, playerSide, innerRadius);
-        vec3 vBroad = spherized - spherizePoint(origin, playerSide, innerRadius);
-        vec3 vApprox = c.x * xJac + c.y * yJac + .5 * (c.x * c.x * xxCurv + 2. * c.x * c.y * xyCurv + c.y * c.y * yyCurv);
-        vApprox *= innerRadius;
+    if (planet.playerSide == int(side)) {
+        vec2 c = local * scale + offset;
+        vCube = c + planet.origin;
+
+        vec3 spherized = spherizePoint(vCube, planet.playerSide, planet.innerRadius);
+        vec3 vBroad = spherized - spherizePoint(planet.origin, planet.playerSide, planet.innerRadius);
+        vec3 vApprox = c.x * planet.xJac + c.y * planet.yJac + .5 * (c.x * c.x * planet.xxCurv + 2. * c.x * c.y * planet.xyCurv + c.y * c.y * planet.yyCurv);
+        vApprox *= planet.innerRadius;
         float mixFactor = smoothstep(0.0, 0.1, length(c));
 
         vPosition = mix(vApprox, vBroad, mixFactor);
 
-        vec3 fxApprox = xJac + xxCurv * c.x + xyCurv * c.y;
-        vec3 fyApprox = yJac + xyCurv * c.x + yyCurv * c.y;
+        vec3 fxApprox = planet.xJac + planet.xxCurv * c.x + planet.xyCurv * c.y;
+        vec3 fyApprox = planet.yJac + planet.xyCurv * c.x + planet.yyCurv * c.y;
         vec3 fxBroad, fyBroad;
-        derivative(vCube, playerSide, fxBroad, fyBroad);
+        derivative(vCube, planet.playerSide, fxBroad, fyBroad);
         vFx = mix(fxApprox, fxBroad, mixFactor);
         vFy = mix(fyApprox, fyBroad, mixFactor);
 
@@ -150,10 +201,10 @@ void main() {
         normal = normalize(mix(nApprox, normalize(spherized), mixFactor));
     }
     else {
-        vCube = pos;
+        vCube = local * scale + offset;
 
-        vec3 spherized = spherizePoint(vCube, int(side), innerRadius);
-        vec3 vBroad = spherized - spherizePoint(origin, playerSide, innerRadius);
+        vec3 spherized = spherizePoint(vCube, int(side), planet.innerRadius);
+        vec3 vBroad = spherized - spherizePoint(planet.origin, planet.playerSide, planet.innerRadius);
 
         vPosition = vBroad;
 
@@ -165,49 +216,51 @@ void main() {
     }
 
     // apply heightmap
-    vec2 t = 1 / vec2(textureSize(tex, 0));
-    vec2 uv = (vUv + 1.0) * .5;
-    uv = mix(t * 2.5, 1 - t * 2.5, uv);
-    float height = texture(tex, vec3(uv, vTexIdx)).r;
-    vec2 baseData = imageLoad(bases, vTexIdx).rg - uBase;
-    float base = baseData.r + baseData.g;
-    height = (height + base) * terrainFactor;
-    vPosition += normal * innerRadius * height;
+    float height = layerHeight(vUv, vTexIdx, texAlign);
+    if (morph > 0) {
+        height = mix(height, layerHeight(vUv * .5 + parentOffset, parentTexIdx, parentTexAlign), morph);
+    }
+    height *= planet.terrainFactor;
+
+    // skirts drop by a few grid cells, enough to cover the height differences
+    // between neighbouring instances
+    height -= pos.z * 4 * scale * node.z / planet.gridSize;
+    vPosition += normal * planet.innerRadius * height;
 
-    vPosition -= eyeOffset;
+    vPosition -= planet.eyeOffset;
 
-    gl_Position = viewProjMat * vec4(vPosition, 1);
+    gl_Position = planet.viewProjMat * vec4(vPosition, 1);
 
 // Sean O'Neil's accurate atmospheric scattering
-    float outerRadius = innerRadius * (1 + th);
+    float outerRadius = planet.innerRadius * (1 + th);
     float outerRadius2 = outerRadius * outerRadius;
 
     // get the ray from the camera to the vertex and its length
     // (which is the far point of the ray passing through the
     //  atmosphere)
-    vec3 cpos = eyePos + vPosition;
+    vec3 cpos = planet.eyePos + vPosition;
     vec3 ray = vPosition;
     float far = length(ray);
     ray /= far;
 
     // Calculate the closest intersection of the ray with
     // the outer atmosphere
-    float cameraHeight2 = dot(eyePos, eyePos);
-    float near = getNearIntersection(eyePos, ray, cameraHeight2, outerRadius2);
+    float cameraHeight2 = dot(planet.eyePos, planet.eyePos);
+    float near = getNearIntersection(planet.eyePos, ray, cameraHeight2, outerRadius2);
 
     // Calculate the ray's starting position, then calculate its scattering offset
-    vec3 start = eyePos + ray * near;
+    vec3 start = planet.eyePos + ray * near;
     far -= near;
-    float depth = exp((innerRadius - outerRadius) / scaleDepth);
+    float depth = exp((planet.innerRadius - outerRadius) / scaleDepth);
     float cameraAngle = dot(-ray, cpos);
-    float lightAngle = dot(lightDir, cpos);
+    float lightAngle = dot(planet.lightDir, cpos);
     float cameraScale = ascale(cameraAngle);
     float lightScale = ascale(lightAngle);
     float cameraOffset = depth * cameraScale;
     float temp = (lightScale + cameraScale);
 
     // initialize the scattering loop variables
-    float pScale = 1.0 / (outerRadius - innerRadius);
+    float pScale = 1.0 / (outerRadius - planet.innerRadius);
     float sampleLength = far / nSamples;
     float scaledLength = sampleLength * pScale;
     vec3 sampleRay = ray * sampleLength;
@@ -218,7 +271,7 @@ void main() {
     vec3 attenuate = vec3(0.0);
     for (int i = 0; i < nSamples; ++i) {
         float height = length(samplePoint);
-        float depth = exp((pScale / scaleDepth) * (innerRadius - height));
+        float depth = exp((pScale / scaleDepth) * (planet.innerRadius - height));
         float scatter = depth * temp - cameraOffset;
         attenuate = exp(-scatter * (invWavelength * kr4PI + km4PI));
         frontColor += attenuate * (depth * scaledLength);
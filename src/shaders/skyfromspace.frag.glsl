@@ -1,7 +1,7 @@
 R"GLSL(
 #version 430 core
 
-layout(std140, binding = 0) uniform Ubo {
+struct Planet {
     mat4 viewProjMat;
     vec3 xJac;
     vec3 yJac;
@@ -16,10 +16,19 @@ layout(std140, binding = 0) uniform Ubo {
     int playerSide;
     float terrainFactor;
     float innerRadius;
+    int gridSize;
 };
 
+// one entry per planet, indexed by the draw within the multi-draw
+layout(std430, binding = 0) readonly buffer Planets {
+    Planet planets[];
+};
+
+Planet planet;
+
 in vec2 vCube;
 in float vLogz;
+flat in int vPlanet;
 in vec3 vPosition;
 
 in vec3 vC0; // rayleigh color
@@ -44,10 +53,12 @@ const float g = -0.990; // The Mie phase asymmetry factor
 const float g2 = g * g;
 
 void main() {
+    planet = planets[vPlanet];
+
     gl_FragDepth = vLogz;
 
     vec3 direction = vPosition;
-    float fCos = dot(lightDir, direction) / length(direction);
+    float fCos = dot(planet.lightDir, direction) / length(direction);
     float fCos2 = fCos * fCos;
     color.rgb = getRayleighPhase(fCos2) * vC0 + getMiePhase(fCos, fCos2, g, g2) * vC1;
     color.a = 0;
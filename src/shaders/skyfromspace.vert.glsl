@@ -1,7 +1,15 @@
 R"GLSL(
 #version 430 core
-
-layout(std140, binding = 0) uniform Ubo {
+#ifdef DRAW_PARAMETERS
+#extension GL_ARB_shader_draw_parameters : require
+#define DRAW_ID gl_DrawIDARB
+#else
+// drawn one planet at a time, with its index set before each draw
+layout(location = 0) uniform int drawId;
+#define DRAW_ID drawId
+#endif
+
+struct Planet {
     mat4 viewProjMat;
     vec3 xJac;
     vec3 yJac;
@@ -16,8 +24,16 @@ layout(std140, binding = 0) uniform Ubo {
     int playerSide;
     float terrainFactor;
     float innerRadius;
+    int gridSize;
+};
+
+// one entry per planet, indexed by the draw within the multi-draw
+layout(std430, binding = 0) readonly buffer Planets {
+    Planet planets[];
 };
 
+Planet planet;
+
 // per-vertex attributes
 layout(location = 0) in vec2 pos;
 
@@ -27,6 +43,7 @@ layout(location = 2) in int side;
 layout(location = 3) in float mapScale;
 layout(location = 4) in vec4 discardRegion;
 
+flat out int vPlanet;
 out vec3 vPosition;
 out vec3 vFx, vFy;
 out float vLogz;
@@ -112,30 +129,33 @@ float ascale(float fCos)
 }
 
 void main() {
-    float outerRadius = innerRadius * (1 + th);
+    vPlanet = DRAW_ID;
+    planet = planets[vPlanet];
+
+    float outerRadius = planet.innerRadius * (1 + th);
     float outerRadius2 = outerRadius * outerRadius;
 
     vec2 c = pos * mapScale + offset;
     vec3 normal;
-    if (playerSide == int(side)) {
-        vec2 cube = c + origin;
+    if (planet.playerSide == int(side)) {
+        vec2 cube = c + planet.origin;
 
-        vec3 spherized = spherizePoint(cube, playerSide, outerRadius);
-        vec3 vBroad = spherized - spherizePoint(origin, playerSide, outerRadius);
+        vec3 spherized = spherizePoint(cube, planet.playerSide, outerRadius);
+        vec3 vBroad = spherized - spherizePoint(planet.origin, planet.playerSide, outerRadius);
 
         // approximate the sphere with taylor approximation
         // (gets rid of fp precision issues)
-        vec3 vApprox = c.x * xJac + c.y * yJac + .5 * (c.x * c.x * xxCurv + 2. * c.x * c.y * xyCurv + c.y * c.y * yyCurv);
+        vec3 vApprox = c.x * planet.xJac + c.y * planet.yJac + .5 * (c.x * c.x * planet.xxCurv + 2. * c.x * c.y * planet.xyCurv + c.y * c.y * planet.yyCurv);
         vApprox *= outerRadius;
         float mixFactor = smoothstep(0.0, 0.1, length(c));
 
         vPosition = mix(vApprox, vBroad, mixFactor);
 
         // calculate normal vector
-        vec3 fxApprox = xJac + xxCurv * c.x + xyCurv * c.y;
-        vec3 fyApprox = yJac + xyCurv * c.x + yyCurv * c.y;
+        vec3 fxApprox = planet.xJac + planet.xxCurv * c.x + planet.xyCurv * c.y;
+        vec3 fyApprox = planet.yJac + planet.xyCurv * c.x + planet.yyCurv * c.y;
         vec3 fxBroad, fyBroad;
-        derivative(cube, playerSide, fxBroad, fyBroad);
+        derivative(cube, planet.playerSide, fxBroad, fyBroad);
         vFx = mix(fxApprox, fxBroad, mixFactor);
         vFy = mix(fyApprox, fyBroad, mixFactor);
 
@@ -145,7 +165,7 @@ void main() {
     }
     else {
         vec3 spherized = spherizePoint(c, int(side), outerRadius);
-        vec3 vBroad = spherized - spherizePoint(origin, playerSide, outerRadius);
+        vec3 vBroad = spherized - spherizePoint(planet.origin, planet.playerSide, outerRadius);
 
         vPosition = vBroad;
 
@@ -157,14 +177,14 @@ void main() {
     }
 
     // adjust with base height
-    float base = (uBase.r + uBase.g) * terrainFactor;
-    vPosition -= normal * innerRadius * base;
-    vPosition -= eyeOffset;
+    float base = (planet.uBase.r + planet.uBase.g) * planet.terrainFactor;
+    vPosition -= normal * planet.innerRadius * base;
+    vPosition -= planet.eyeOffset;
 
     // adjust for atmosphere thickness
-    vPosition += normal * (outerRadius - innerRadius);
+    vPosition += normal * (outerRadius - planet.innerRadius);
 
-    gl_Position = viewProjMat * vec4(vPosition, 1);
+    gl_Position = planet.viewProjMat * vec4(vPosition, 1);
 
 // Sean O'Neil's accurate atmospheric scattering
     // get the ray from the camera to the vertex and its length
@@ -177,16 +197,16 @@ void main() {
 
     // Calculate the closest intersection of the ray with
     // the outer atmosphere
-    float cameraHeight2 = dot(eyePos, eyePos);
-    float near = getNearIntersection(eyePos, ray, cameraHeight2, outerRadius2);
-    vec3 start = eyePos + ray * near;
+    float cameraHeight2 = dot(planet.eyePos, planet.eyePos);
+    float near = getNearIntersection(planet.eyePos, ray, cameraHeight2, outerRadius2);
+    vec3 start = planet.eyePos + ray * near;
     far -= near;
     float startAngle = dot(ray, start) / outerRadius;
     float startDepth = exp(-1.0 / scaleDepth);
     float startOffset = startDepth * ascale(startAngle);
 
     // initialize the scattering loop variables
-    float pScale = 1.0 / (outerRadius - innerRadius);
+    float pScale = 1.0 / (outerRadius - planet.innerRadius);
     float sampleLength = far / float(nSamples);
     float scaledLength = sampleLength * pScale;
     vec3 sampleRay = ray * sampleLength;
@@ -196,8 +216,8 @@ void main() {
     vec3 frontColor = vec3(0.0);
     for (int i = 0; i < nSamples; ++i) {
         float height = length(samplePoint);
-        float depth = exp((pScale / scaleDepth) * (innerRadius - height));
-        float lightAngle = dot(lightDir, samplePoint) / height;
+        float depth = exp((pScale / scaleDepth) * (planet.innerRadius - height));
+        float lightAngle = dot(planet.lightDir, samplePoint) / height;
         float cameraAngle = dot(ray, samplePoint) / height;
         float scatter = (startOffset + depth * (ascale(lightAngle) - ascale(cameraAngle)));
         vec3 attenuate = exp(-scatter * (invWavelength * kr4PI + km4PI));
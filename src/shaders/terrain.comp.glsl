@@ -2,7 +2,19 @@ R"GLSL(
 #version 430
 #define WORKGROUP_SIZE 32
 layout(local_size_x = WORKGROUP_SIZE, local_size_y = WORKGROUP_SIZE, local_size_z = 1) in;
-layout(r32f, binding = 0) uniform image2DArray image;
+layout(binding = 0) uniform writeonly image2DArray image;
+layout(rg16f, binding = 4) uniform image2DArray gradImage;
+
+// BASIS, like the shape constants below, is #defined from the planet's noise preset
+#define BASIS_SIMPLEX 0
+#define BASIS_INTEGER_HASH 1
+
+// scale and offset that decode the stored heights
+layout(location = 1) uniform vec2 encoding;
+
+// face to generate and the pool layer it goes into
+layout(location = 2) uniform int uSide;
+layout(location = 3) uniform int uLayer;
 
 #define DECL_FASTMOD_N(n, k) vec##k mod##n(vec##k x) { return x - floor(x * (1.0 / n)) * n; }
 
@@ -98,12 +110,160 @@ float snoise(vec3 v) {
                                 dot(p2,x2), dot(p3,x3) ) );
 }
 
+// Simplex noise along with its analytic gradient
+float snoise(vec3 v, out vec3 gradient) {
+    const vec2  C = vec2(1.0/6.0, 1.0/3.0) ;
+    const vec4  D = vec4(0.0, 0.5, 1.0, 2.0);
+
+    // First corner
+    vec3 i  = floor(v + dot(v, C.yyy) );
+    vec3 x0 =   v - i + dot(i, C.xxx) ;
+
+    // Other corners
+    vec3 g = step(x0.yzx, x0.xyz);
+    vec3 l = 1.0 - g;
+    vec3 i1 = min( g.xyz, l.zxy );
+    vec3 i2 = max( g.xyz, l.zxy );
+
+    vec3 x1 = x0 - i1 + C.xxx;
+    vec3 x2 = x0 - i2 + C.yyy; // 2.0*C.x = 1/3 = C.y
+    vec3 x3 = x0 - D.yyy;      // -1.0+3.0*C.x = -0.5 = -D.y
+
+    // Permutations
+    i = mod289(i);
+    vec4 p = permute( permute( permute(
+             i.z + vec4(0.0, i1.z, i2.z, 1.0 ))
+           + i.y + vec4(0.0, i1.y, i2.y, 1.0 ))
+           + i.x + vec4(0.0, i1.x, i2.x, 1.0 ));
+
+    // Gradients: 7x7 points over a square, mapped onto an octahedron.
+    // The ring size 17*17 = 289 is close to a multiple of 49 (49*6 = 294)
+    float n_ = 0.142857142857; // 1.0/7.0
+    vec3  ns = n_ * D.wyz - D.xzx;
+
+    vec4 j = p - 49.0 * floor(p * ns.z * ns.z);  //  mod(p,7*7)
+
+    vec4 x_ = floor(j * ns.z);
+    vec4 y_ = floor(j - 7.0 * x_ );    // mod(j,N)
+
+    vec4 x = x_ *ns.x + ns.yyyy;
+    vec4 y = y_ *ns.x + ns.yyyy;
+    vec4 h = 1.0 - abs(x) - abs(y);
+
+    vec4 b0 = vec4( x.xy, y.xy );
+    vec4 b1 = vec4( x.zw, y.zw );
+
+    vec4 s0 = floor(b0)*2.0 + 1.0;
+    vec4 s1 = floor(b1)*2.0 + 1.0;
+    vec4 sh = -step(h, vec4(0.0));
+
+    vec4 a0 = b0.xzyw + s0.xzyw*sh.xxyy ;
+    vec4 a1 = b1.xzyw + s1.xzyw*sh.zzww ;
+
+    vec3 p0 = vec3(a0.xy,h.x);
+    vec3 p1 = vec3(a0.zw,h.y);
+    vec3 p2 = vec3(a1.xy,h.z);
+    vec3 p3 = vec3(a1.zw,h.w);
+
+    //Normalise gradients
+    vec4 norm = taylorInvSqrt(vec4(dot(p0,p0), dot(p1,p1), dot(p2, p2), dot(p3,p3)));
+    p0 *= norm.x;
+    p1 *= norm.y;
+    p2 *= norm.z;
+    p3 *= norm.w;
+
+    // Mix final noise value
+    vec4 m = max(0.6 - vec4(dot(x0,x0), dot(x1,x1), dot(x2,x2), dot(x3,x3)), 0.0);
+    vec4 m2 = m * m;
+    vec4 m4 = m2 * m2;
+    vec4 pdotx = vec4(dot(p0,x0), dot(p1,x1), dot(p2,x2), dot(p3,x3));
+
+    // d(m^4 * pdotx) = -8 m^3 pdotx x + m^4 p
+    vec4 temp = m2 * m * pdotx;
+    gradient = -8.0 * (temp.x * x0 + temp.y * x1 + temp.z * x2 + temp.w * x3);
+    gradient += m4.x * p0 + m4.y * p1 + m4.z * p2 + m4.w * p3;
+    gradient *= 42.0;
+
+    return 42.0 * dot(m4, pdotx);
+}
+
+uvec3 pcg3d(uvec3 v) {
+    v = v * 1664525u + 1013904223u;
+    v.x += v.y * v.z;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    v ^= v >> 16u;
+    v.x += v.y * v.z;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    return v;
+}
+
+// pseudo-random gradient in [-1, 1]^3 at a lattice point
+vec3 latticeGradient(ivec3 cell) {
+    uvec3 lo = uvec3(cell);
+    uvec3 hi = uvec3(cell >> 31);
+    uvec3 h = pcg3d(lo + pcg3d(hi));
+    return vec3(h) * (2.0 / 4294967295.0) - 1.0;
+}
+
+// Gradient noise over the integer lattice, along with its analytic gradient
+float hashNoise(vec3 v, out vec3 gradient) {
+    ivec3 i = ivec3(floor(v));
+    vec3 f = v - vec3(i);
+
+    vec3 ga = latticeGradient(i);
+    vec3 gb = latticeGradient(i + ivec3(1, 0, 0));
+    vec3 gc = latticeGradient(i + ivec3(0, 1, 0));
+    vec3 gd = latticeGradient(i + ivec3(1, 1, 0));
+    vec3 ge = latticeGradient(i + ivec3(0, 0, 1));
+    vec3 gf = latticeGradient(i + ivec3(1, 0, 1));
+    vec3 gg = latticeGradient(i + ivec3(0, 1, 1));
+    vec3 gh = latticeGradient(i + ivec3(1, 1, 1));
+
+    float va = dot(ga, f);
+    float vb = dot(gb, f - vec3(1, 0, 0));
+    float vc = dot(gc, f - vec3(0, 1, 0));
+    float vd = dot(gd, f - vec3(1, 1, 0));
+    float ve = dot(ge, f - vec3(0, 0, 1));
+    float vf = dot(gf, f - vec3(1, 0, 1));
+    float vg = dot(gg, f - vec3(0, 1, 1));
+    float vh = dot(gh, f - vec3(1, 1, 1));
+
+    // quintic interpolant and its derivative
+    vec3 u = f * f * f * (f * (f * 6.0 - 15.0) + 10.0);
+    vec3 du = 30.0 * f * f * (f * (f - 2.0) + 1.0);
+
+    float k4 = va - vb - vc + vd;
+    float k5 = va - vc - ve + vg;
+    float k6 = va - vb - ve + vf;
+    float k7 = -va + vb + vc - vd + ve - vf - vg + vh;
+
+    gradient = ga + u.x * (gb - ga) + u.y * (gc - ga) + u.z * (ge - ga)
+        + u.x * u.y * (ga - gb - gc + gd) + u.y * u.z * (ga - gc - ge + gg)
+        + u.z * u.x * (ga - gb - ge + gf) + u.x * u.y * u.z * (-ga + gb + gc - gd + ge - gf - gg + gh)
+        + du * (vec3(vb - va, vc - va, ve - va)
+            + u.yzx * vec3(k4, k5, k6) + u.zxy * vec3(k6, k4, k5) + u.yzx * u.zxy * k7);
+
+    return va + u.x * (vb - va) + u.y * (vc - va) + u.z * (ve - va)
+        + u.x * u.y * k4 + u.y * u.z * k5 + u.z * u.x * k6 + u.x * u.y * u.z * k7;
+}
+
+float basisNoise(vec3 v, out vec3 gradient) {
+#if BASIS == BASIS_INTEGER_HASH
+    return hashNoise(v, gradient);
+#else
+    return snoise(v, gradient);
+#endif
+}
+
 // Cellular noise, returning F1 and F2 in a vec2.
 // Speeded up by using 2x2x2 search window instead of 3x3x3,
 // at the expense of some pattern artifacts.
 // F2 is often wrong and has sharp discontinuities.
 // If you need a good F2, use the slower 3x3x3 version.
-float cellular2x2x2(vec3 P) {
+// Also returns the gradient of F1, which points away from the nearest feature point.
+float cellular2x2x2(vec3 P, out vec3 gradient) {
 #define K 0.142857142857 // 1/7
 #define Ko 0.428571428571 // 1/2-K/2
 #define K2 0.020408163265306 // 1/(7*7)
@@ -133,62 +293,128 @@ float cellular2x2x2(vec3 P) {
     vec4 d1 = dx1 * dx1 + dy1 * dy1 + dz1 * dz1; // z+0
     vec4 d2 = dx2 * dx2 + dy2 * dy2 + dz2 * dz2; // z+1
 
-    // Cheat and sort out only F1
-    d1 = min(d1, d2);
-    d1.xy = min(d1.xy, d1.wz);
-    d1.x = min(d1.x, d1.y);
-    return sqrt(d1.x);
+    // Cheat and sort out only F1, keeping the offset to the nearest feature point
+    vec4 sel = step(d2, d1);
+    d1 = mix(d1, d2, sel);
+    dx1 = mix(dx1, dx2, sel);
+    dy1 = mix(dy1, dy2, sel);
+    dz1 = mix(dz1, dz2, sel);
+
+    float f1 = d1.x;
+    vec3 offset = vec3(dx1.x, dy1.x, dz1.x);
+    if (d1.y < f1) {
+        f1 = d1.y;
+        offset = vec3(dx1.y, dy1.y, dz1.y);
+    }
+    if (d1.z < f1) {
+        f1 = d1.z;
+        offset = vec3(dx1.z, dy1.z, dz1.z);
+    }
+    if (d1.w < f1) {
+        f1 = d1.w;
+        offset = vec3(dx1.w, dy1.w, dz1.w);
+    }
+
+    f1 = sqrt(f1);
+    gradient = offset / max(f1, 1e-6);
+    return f1;
+}
+
+float ridgeNoise(vec3 v, out vec3 gradient)
+{
+    float n = basisNoise(v, gradient);
+    gradient *= 2 * sign(.5 - n);
+    float ridge = 2 * (.5 - abs(0.5 - n));
+#if RIDGE_EXPONENT_NUM != RIDGE_EXPONENT_DEN
+    // sign(ridge) * |ridge|^e, with the derivative e * |ridge|^(e - 1)
+    const float e = float(RIDGE_EXPONENT_NUM) / float(RIDGE_EXPONENT_DEN);
+    float a = max(abs(ridge), 1e-6);
+    gradient *= e * pow(a, e - 1);
+    ridge = sign(ridge) * pow(a, e);
+#endif
+    return ridge;
 }
 
-float ridgeNoise(vec3 v)
+// Octaves above maxFreq are finer than a texel and would only alias, so they
+// fade out from half of maxFreq and are not evaluated at all past it.
+float octaveWeight(float freq, float maxFreq)
 {
-    return 2 * (.5 - abs(0.5 - snoise(v)));
-    //return -abs(abs(2 * snoise(v)) - 1) + 1;
+    return 1 - smoothstep(.5 * maxFreq, maxFreq, freq);
 }
 
-float octaveNoise(vec3 pos, int octaves, float freq, float persistence)
+// amplitude of all octaves together, which keeps truncated sums on the same scale
+float octaveAmplitude(int octaves, float persistence)
+{
+    return persistence == 1.0 ? float(octaves) : (1 - pow(persistence, float(octaves))) / (1 - persistence);
+}
+
+float octaveNoise(vec3 pos, int octaves, float freq, float persistence, float maxFreq, out vec3 gradient)
 {
     float total = 0.0;
-    float maxAmplitude = 0.0;
     float amplitude = 1.0;
+    gradient = vec3(0.0);
     for (int i = 0; i < octaves; ++i) {
-        total += snoise(pos * freq) * amplitude;
+        float weight = octaveWeight(freq, maxFreq);
+        if (weight <= 0) {
+            break;
+        }
+
+        vec3 g;
+        total += basisNoise(pos * freq, g) * amplitude * weight;
+        gradient += g * (freq * amplitude * weight);
         freq *= 2.0;
-        maxAmplitude += amplitude;
         amplitude *= persistence;
     }
 
+    float maxAmplitude = octaveAmplitude(octaves, persistence);
+    gradient /= maxAmplitude;
     return total / maxAmplitude;
 }
 
-float octaveRidgeNoise(vec3 pos, int octaves, float freq, float persistence)
+float octaveRidgeNoise(vec3 pos, int octaves, float freq, float persistence, float maxFreq, out vec3 gradient)
 {
     float total = 0.0;
-    float maxAmplitude = 0.0;
     float amplitude = 1.0;
+    gradient = vec3(0.0);
     for (int i = 0; i < octaves; ++i) {
-        total += ridgeNoise(pos * freq) * amplitude;
+        float weight = octaveWeight(freq, maxFreq);
+        if (weight <= 0) {
+            break;
+        }
+
+        vec3 g;
+        total += ridgeNoise(pos * freq, g) * amplitude * weight;
+        gradient += g * (freq * amplitude * weight);
         freq *= 2.0;
-        maxAmplitude += amplitude;
         amplitude *= persistence;
     }
 
+    float maxAmplitude = octaveAmplitude(octaves, persistence);
+    gradient /= maxAmplitude;
     return total / maxAmplitude;
 }
 
-float octaveWorleyNoise(vec3 pos, int octaves, float freq, float persistence)
+float octaveWorleyNoise(vec3 pos, int octaves, float freq, float persistence, float maxFreq, out vec3 gradient)
 {
     float total = 0.0;
-    float maxAmplitude = 0.0;
     float amplitude = 1.0;
+    gradient = vec3(0.0);
     for (int i = 0; i < octaves; ++i) {
-        float noise = cellular2x2x2(pos * freq);
-        total += pow(noise, 3) * amplitude;
+        float weight = octaveWeight(freq, maxFreq);
+        if (weight <= 0) {
+            break;
+        }
+
+        vec3 g;
+        float noise = cellular2x2x2(pos * freq, g);
+        total += noise * noise * noise * amplitude * weight;
+        gradient += 3 * noise * noise * g * (freq * amplitude * weight);
         freq *= 2.0;
-        maxAmplitude += amplitude;
         amplitude *= persistence;
     }
 
+    float maxAmplitude = octaveAmplitude(octaves, persistence);
+    gradient /= maxAmplitude;
     return total / maxAmplitude;
 }
 
@@ -226,27 +452,62 @@ vec3 spherizePoint(vec2 q, int side)
     );
 }
 
-#define MARGIN 2
+void derivative(vec2 cube, int side, out vec3 dfdx, out vec3 dfdy)
+{
+    vec2 sq = cube * cube;
+    float t = .5 * inversesqrt(1 - sq.x / 2 - sq.y / 2 + sq.x * sq.y / 3);
+    dfdx = vec3(sqrt(.5 - sq.y / 6),
+                -cube.x * cube.y / 6 * inversesqrt(.5 - sq.x / 6),
+                t * (2. / 3. * sq.y * cube.x - cube.x));
+    dfdx = applySide(dfdx, side);
+
+    dfdy = vec3(-cube.x * cube.y / 6 * inversesqrt(.5 - sq.y / 6),
+                sqrt(.5 - sq.x / 6),
+                t * (2. / 3. * sq.x * cube.y - cube.y));
+    dfdy = applySide(dfdy, side);
+}
 
 void main() {
-    ivec3 pixel_coords = ivec3(gl_GlobalInvocationID.xyz);
+    ivec3 pixel_coords = ivec3(gl_GlobalInvocationID.xy, uLayer);
     vec2 imgSize = vec2(imageSize(image).xy);
-    vec2 t = 1 / imgSize;
 
-    // map [MARGIN, N-1-MARGIN] -> [1/(2N), 1-1/(2N)]
-    vec2 uv = mix(t * .5, 1 - t * .5, vec2(pixel_coords.xy - MARGIN) / (imgSize - (MARGIN * 2 + 1)));
+    // texel centers, the N texels spanning the whole face
+    vec2 uv = (vec2(pixel_coords.xy) + .5) / imgSize;
     vec2 xy = uv * 2. - 1.;
-    vec3 pos = spherizePoint(xy, pixel_coords.z);
+    vec3 pos = spherizePoint(xy, uSide);
+
+    // highest frequency representable on the unit sphere at this resolution
+    float maxFreq = imgSize.x / 4;
+
+    // the shape constants are #defined from terrain.h, which evaluates the
+    // same sums on the CPU
+    vec3 g;
+    float height = octaveRidgeNoise(pos, RIDGE_OCTAVES, RIDGE_FREQUENCY, RIDGE_PERSISTENCE, maxFreq, g)
+        * RIDGE_SCALE + RIDGE_OFFSET;
+    vec3 gradient = g * RIDGE_SCALE;
+
+    float n = octaveNoise(pos, MASK_OCTAVES, MASK_FREQUENCY, MASK_PERSISTENCE, maxFreq, g);
+    float mul = n * n * n * MASK_GAIN;
+    vec3 dMul = (mul > 0 && mul < 1) ? 3 * MASK_GAIN * n * n * g : vec3(0.0);
+    mul = clamp(mul, 0, 1);
+
+    float mountains = octaveWorleyNoise(pos, CELL_OCTAVES, CELL_FREQUENCY, CELL_PERSISTENCE, maxFreq, g)
+        * CELL_SCALE + CELL_OFFSET;
+    vec3 dMountains = g * CELL_SCALE;
+    mountains += octaveRidgeNoise(pos, MOUNTAIN_OCTAVES, MOUNTAIN_FREQUENCY, MOUNTAIN_PERSISTENCE, maxFreq, g)
+        + MOUNTAIN_OFFSET;
+    dMountains += g;
 
-    //float height = (ridgeWithOctaves(pos * 2.0, 20) - 1.0);
-    float height = octaveRidgeNoise(pos, 8, 1.0, 0.8) * .5 + .1;
-    float mul = clamp(pow(octaveNoise(pos, 7, 2.0, 0.7), 3.0) * 30, 0, 1);
-    float mountains = octaveWorleyNoise(pos, 1, 90.0, 0.6) * 1.5 + .2;
-    mountains += octaveRidgeNoise(pos, 11, 10.0, 0.6) + .5;
     height += mul * mountains;
-    vec4 pixel = vec4(height, 0.0, 0.0, 1.0);
+    gradient += dMul * mountains + mul * dMountains;
+    vec4 pixel = vec4((height - encoding.y) / encoding.x, 0.0, 0.0, 1.0);
 
     // output to a specific pixel in the image
     imageStore(image, pixel_coords, pixel);
+
+    // gradient with respect to the face coordinates
+    vec3 dfdx, dfdy;
+    derivative(xy, uSide, dfdx, dfdy);
+    imageStore(gradImage, pixel_coords, vec4(dot(gradient, dfdx), dot(gradient, dfdy), 0.0, 0.0));
 }
 )GLSL"
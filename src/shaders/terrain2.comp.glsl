@@ -2,9 +2,13 @@ R"GLSL(
 #version 430
 #define WORKGROUP_SIZE 32
 layout(local_size_x = WORKGROUP_SIZE, local_size_y = WORKGROUP_SIZE, local_size_z = 1) in;
-layout(r32f, binding = 0) uniform image2D image;
+layout(binding = 0) uniform writeonly image2DArray image;
 layout(binding = 1) uniform sampler2DArray tex;
-layout(rg32f, binding = 2) uniform image1D bases;
+
+// base hi, base lo, then the scale and offset that decode the stored heights
+layout(rgba32f, binding = 2) uniform image1D bases;
+layout(rg16f, binding = 4) uniform writeonly image2DArray gradImage;
+layout(binding = 4) uniform sampler2DArray gradTex;
 
 struct Lod
 {
@@ -14,19 +18,36 @@ struct Lod
     int imgIdx;
     int parentIdx;
     int lod;
+    uvec4 texelOrigin; // 64-bit index of texel (0, 0) along the face, low words in xy
 };
 
 layout(std140, binding = 3) uniform LodData
 {
-    Lod uLods[36];
+    Lod uLods[64];
+};
+
+// one item per z: the lod to generate and the physical texels to write,
+// as offset and size of a region that wraps around the layer; incremental
+// items keep the rest of the layer and with it its base
+struct Item
+{
+    ivec4 region;
+    int lodIdx;
+    int incremental;
+};
+
+layout(std430, binding = 7) readonly buffer Items
+{
+    Item uItems[];
 };
 
-// side == -1: z = side
-// side >= 0: z = lod
-layout(location = 0) uniform int side;
-layout(location = 1) uniform vec3 xJac;
-layout(location = 2) uniform vec3 yJac;
-layout(location = 3) uniform int uIdx;
+#define BASIS_SIMPLEX 0
+#define BASIS_INTEGER_HASH 1
+layout(location = 4) uniform int basis;
+
+// detail noise lattice cells are 2^CELL_SHIFT texels wide
+#define CELL_SHIFT 2
+#define CELL_TEXELS (1 << CELL_SHIFT)
 
 #define DECL_FASTMOD_N(n, k) vec##k mod##n(vec##k x) { return x - floor(x * (1.0 / n)) * n; }
 
@@ -117,6 +138,127 @@ float snoise(vec3 v) {
                                 dot(p2,x2), dot(p3,x3) ) );
 }
 
+// Simplex noise along with its analytic gradient
+float snoise(vec3 v, out vec3 gradient) {
+    const vec2  C = vec2(1.0/6.0, 1.0/3.0) ;
+    const vec4  D = vec4(0.0, 0.5, 1.0, 2.0);
+
+    // First corner
+    vec3 i  = floor(v + dot(v, C.yyy) );
+    vec3 x0 =   v - i + dot(i, C.xxx) ;
+
+    // Other corners
+    vec3 g = step(x0.yzx, x0.xyz);
+    vec3 l = 1.0 - g;
+    vec3 i1 = min( g.xyz, l.zxy );
+    vec3 i2 = max( g.xyz, l.zxy );
+
+    vec3 x1 = x0 - i1 + C.xxx;
+    vec3 x2 = x0 - i2 + C.yyy; // 2.0*C.x = 1/3 = C.y
+    vec3 x3 = x0 - D.yyy;      // -1.0+3.0*C.x = -0.5 = -D.y
+
+    // Permutations
+    i = mod289(i);
+    vec4 p = permute( permute( permute(
+             i.z + vec4(0.0, i1.z, i2.z, 1.0 ))
+           + i.y + vec4(0.0, i1.y, i2.y, 1.0 ))
+           + i.x + vec4(0.0, i1.x, i2.x, 1.0 ));
+
+    // Gradients: 7x7 points over a square, mapped onto an octahedron.
+    // The ring size 17*17 = 289 is close to a multiple of 49 (49*6 = 294)
+    float n_ = 0.142857142857; // 1.0/7.0
+    vec3  ns = n_ * D.wyz - D.xzx;
+
+    vec4 j = p - 49.0 * floor(p * ns.z * ns.z);  //  mod(p,7*7)
+
+    vec4 x_ = floor(j * ns.z);
+    vec4 y_ = floor(j - 7.0 * x_ );    // mod(j,N)
+
+    vec4 x = x_ *ns.x + ns.yyyy;
+    vec4 y = y_ *ns.x + ns.yyyy;
+    vec4 h = 1.0 - abs(x) - abs(y);
+
+    vec4 b0 = vec4( x.xy, y.xy );
+    vec4 b1 = vec4( x.zw, y.zw );
+
+    vec4 s0 = floor(b0)*2.0 + 1.0;
+    vec4 s1 = floor(b1)*2.0 + 1.0;
+    vec4 sh = -step(h, vec4(0.0));
+
+    vec4 a0 = b0.xzyw + s0.xzyw*sh.xxyy ;
+    vec4 a1 = b1.xzyw + s1.xzyw*sh.zzww ;
+
+    vec3 p0 = vec3(a0.xy,h.x);
+    vec3 p1 = vec3(a0.zw,h.y);
+    vec3 p2 = vec3(a1.xy,h.z);
+    vec3 p3 = vec3(a1.zw,h.w);
+
+    //Normalise gradients
+    vec4 norm = taylorInvSqrt(vec4(dot(p0,p0), dot(p1,p1), dot(p2, p2), dot(p3,p3)));
+    p0 *= norm.x;
+    p1 *= norm.y;
+    p2 *= norm.z;
+    p3 *= norm.w;
+
+    // Mix final noise value
+    vec4 m = max(0.6 - vec4(dot(x0,x0), dot(x1,x1), dot(x2,x2), dot(x3,x3)), 0.0);
+    vec4 m2 = m * m;
+    vec4 m4 = m2 * m2;
+    vec4 pdotx = vec4(dot(p0,x0), dot(p1,x1), dot(p2,x2), dot(p3,x3));
+
+    // d(m^4 * pdotx) = -8 m^3 pdotx x + m^4 p
+    vec4 temp = m2 * m * pdotx;
+    gradient = -8.0 * (temp.x * x0 + temp.y * x1 + temp.z * x2 + temp.w * x3);
+    gradient += m4.x * p0 + m4.y * p1 + m4.z * p2 + m4.w * p3;
+    gradient *= 42.0;
+
+    return 42.0 * dot(m4, pdotx);
+}
+
+uvec3 pcg3d(uvec3 v) {
+    v = v * 1664525u + 1013904223u;
+    v.x += v.y * v.z;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    v ^= v >> 16u;
+    v.x += v.y * v.z;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    return v;
+}
+
+// pseudo-random gradient in [-1, 1]^2 at the 64-bit lattice point (lo + d, hi)
+vec2 latticeGradient(uvec2 lo, uvec2 hi, uvec2 d) {
+    uvec2 carry;
+    lo = uaddCarry(lo, d, carry);
+    hi += carry;
+    uvec3 h = pcg3d(uvec3(lo, hi.x * 0x9E3779B9u ^ hi.y));
+    return vec2(h.xy) * (2.0 / 4294967295.0) - 1.0;
+}
+
+// 2D gradient noise over an exact 64-bit integer lattice,
+// along with its analytic gradient
+float hashNoise(uvec2 lo, uvec2 hi, vec2 f, out vec2 gradient) {
+    vec2 ga = latticeGradient(lo, hi, uvec2(0, 0));
+    vec2 gb = latticeGradient(lo, hi, uvec2(1, 0));
+    vec2 gc = latticeGradient(lo, hi, uvec2(0, 1));
+    vec2 gd = latticeGradient(lo, hi, uvec2(1, 1));
+
+    float va = dot(ga, f);
+    float vb = dot(gb, f - vec2(1, 0));
+    float vc = dot(gc, f - vec2(0, 1));
+    float vd = dot(gd, f - vec2(1, 1));
+
+    // quintic interpolant and its derivative
+    vec2 u = f * f * f * (f * (f * 6.0 - 15.0) + 10.0);
+    vec2 du = 30.0 * f * f * (f * (f - 2.0) + 1.0);
+
+    float k = va - vb - vc + vd;
+    gradient = ga + u.x * (gb - ga) + u.y * (gc - ga) + u.x * u.y * (ga - gb - gc + gd)
+        + du * (u.yx * k + vec2(vb, vc) - va);
+    return va + u.x * (vb - va) + u.y * (vc - va) + u.x * u.y * k;
+}
+
 float ridgeNoise(vec3 v)
 {
     return 2 * (.5 - abs(0.5 - snoise(v)));
@@ -198,7 +340,10 @@ vec4 cubic(float v)
     return vec4(x, y, z, w);
 }
 
-vec4 filt(vec2 texcoord, vec2 texscale, int idx)
+// bicubic filtering from four bilinear taps; detail layers are toroidal and
+// wrap, but a face layer is not and its edges clamp like GL_CLAMP_TO_EDGE,
+// rather than take taps from the opposite edge of the face
+vec4 filt(sampler2DArray src, vec2 texcoord, vec2 texscale, int idx, bool clampToEdge)
 {
     float fx = fract(texcoord.x);
     float fy = fract(texcoord.y);
@@ -211,11 +356,14 @@ vec4 filt(vec2 texcoord, vec2 texscale, int idx)
     vec4 c = vec4(texcoord.x - 0.5, texcoord.x + 1.5, texcoord.y - 0.5, texcoord.y + 1.5);
     vec4 s = vec4(xcubic.xz + xcubic.yw, ycubic.xz + ycubic.yw);
     vec4 offset = c + vec4(xcubic.yw, ycubic.yw) / s;
+    if (clampToEdge) {
+        offset = clamp(offset, .5, 1 / texscale.x - .5);
+    }
 
-    vec4 sample0 = texture(tex, vec3(offset.xz * texscale, idx));
-    vec4 sample1 = texture(tex, vec3(offset.yz * texscale, idx));
-    vec4 sample2 = texture(tex, vec3(offset.xw * texscale, idx));
-    vec4 sample3 = texture(tex, vec3(offset.yw * texscale, idx));
+    vec4 sample0 = texture(src, vec3(offset.xz * texscale, idx));
+    vec4 sample1 = texture(src, vec3(offset.yz * texscale, idx));
+    vec4 sample2 = texture(src, vec3(offset.xw * texscale, idx));
+    vec4 sample3 = texture(src, vec3(offset.yw * texscale, idx));
 
     float sx = s.x / (s.x + s.y);
     float sy = s.z / (s.z + s.w);
@@ -225,42 +373,91 @@ vec4 filt(vec2 texcoord, vec2 texscale, int idx)
         mix(sample1, sample0, sx), sy);
 }
 
-#define MARGIN 2
-
 void main() {
-    ivec2 pixel_coords = ivec2(gl_GlobalInvocationID.xy);
-    vec2 imgSize = vec2(imageSize(image).xy);
-    vec2 t = 1 / imgSize;
+    Item item = uItems[gl_GlobalInvocationID.z];
+    ivec2 size = imageSize(image).xy;
+    if (any(greaterThanEqual(ivec2(gl_GlobalInvocationID.xy), item.region.zw))) {
+        return;
+    }
+
+    // layers are stored toroidally: the texel with index i along the face lives
+    // at i mod N, and lod.align is where texel 0 of the window lives
+    ivec2 pixel_coords = (item.region.xy + ivec2(gl_GlobalInvocationID.xy)) % size;
+    vec2 imgSize = vec2(size);
 
-    Lod lod = uLods[uIdx];
+    Lod lod = uLods[item.lodIdx];
 
-    // map [0, N-1] -> [1/(2N), 1-1/(2N)]
-    vec2 uv = vec2(pixel_coords.xy) / imgSize;
+    // texel center within the window, [1/(2N), 1-1/(2N)]
+    ivec2 windowTexel = (pixel_coords - ivec2(round(lod.align * imgSize)) + size) % size;
+    vec2 uv = (vec2(windowTexel) + .5) / imgSize;
 
     // bicubic filter upsample parent
     Lod plod = uLods[lod.parentIdx];
-    vec2 pOffset = lod.pDiff * (1 - (MARGIN * 2 + 1) * t);
-    vec2 pUv = uv / 2 + .25 + pOffset;
-    vec4 pixel = filt(pUv * imgSize, 1 / imgSize, plod.imgIdx);
-    float base = texture(tex, vec3(.5, .5, plod.imgIdx)).r;
+    vec4 pBase = imageLoad(bases, plod.imgIdx);
+    vec2 pUv = uv / 2 + .25 + lod.pDiff + plod.align;
+    bool faceParent = lod.lod == 1;
+    vec4 pixel = filt(tex, pUv * imgSize, 1 / imgSize, plod.imgIdx, faceParent) * pBase.z + pBase.w;
+    float base;
+    if (item.incremental != 0) {
+        // exact as long as the parent has the base this layer was made from
+        vec4 own = imageLoad(bases, lod.imgIdx);
+        base = (own.x - pBase.x) + (own.y - pBase.y);
+    }
+    else {
+        base = texture(tex, vec3(vec2(.5) + plod.align, plod.imgIdx)).r * pBase.z + pBase.w;
+    }
     pixel.x -= base;
 
+    // parent gradient is per parent-local unit, which spans two local units here
+    vec2 gradient = filt(gradTex, pUv * imgSize, 1 / imgSize, plod.imgIdx, faceParent).xy * .5;
+
     // generate heightmap by perlin noise
-    vec2 xy = (fract(uv + lod.align) * 2 - 1) * lod.scale;
-    pixel.x += snoise(xy.xyy / lod.scale * exp2(13)) * pow(lod.scale, 0.8) / 16;
+    // a lattice cell spans CELL_TEXELS texels whatever the layer size, so the
+    // analytic gradient matches the stored heights; freq is in cells per
+    // window-local unit, half the window
+    const float freq = imgSize.x / (2 * CELL_TEXELS);
+    float amplitude = pow(lod.scale, 0.8) / 16;
+    float noise;
+    vec2 dNoise;
+    if (basis == BASIS_INTEGER_HASH) {
+        // exact 64-bit texel index along the face, split into cell and fraction
+        uvec2 carry;
+        uvec2 lo = uaddCarry(lod.texelOrigin.xy, uvec2(windowTexel), carry);
+        uvec2 hi = lod.texelOrigin.zw + carry;
+        vec2 f = vec2(lo & uint(CELL_TEXELS - 1)) / CELL_TEXELS;
+        lo = (lo >> CELL_SHIFT) | (hi << (32 - CELL_SHIFT));
+        hi = uvec2(ivec2(hi) >> CELL_SHIFT);
+        noise = hashNoise(lo, hi, f, dNoise);
+    }
+    else {
+        vec2 xy = ((vec2(pixel_coords) + .5) / imgSize * 2 - 1) * lod.scale;
+        vec3 g;
+        noise = snoise(xy.xyy / lod.scale * freq, g);
+        dNoise = vec2(g.x, g.y + g.z);
+    }
+    pixel.x += noise * amplitude;
+    gradient += dNoise * (freq * amplitude);
     //pixel.x += xy.x + xy.y;
 
+    // the encoding of this layer is set up before generation
+    vec2 encoding = imageLoad(bases, lod.imgIdx).zw;
+
     // output to a specific pixel in the image
-    imageStore(image, pixel_coords, pixel);
+    pixel.x = (pixel.x - encoding.y) / encoding.x;
+    imageStore(image, ivec3(pixel_coords, lod.imgIdx), pixel);
+    imageStore(gradImage, ivec3(pixel_coords, lod.imgIdx), vec4(gradient, 0.0, 0.0));
+
+    if (item.incremental != 0) {
+        return;
+    }
 
-    vec4 pBase = imageLoad(bases, plod.imgIdx);
     if (lod.lod < 15) {
         pBase.x += base;
     }
     else {
         pBase.y += base;
     }
-    imageStore(bases, lod.imgIdx, pBase);
+    imageStore(bases, lod.imgIdx, vec4(pBase.xy, encoding));
 }
 
 )GLSL"
@@ -0,0 +1,85 @@
+R"GLSL(
+#version 430
+#define WORKGROUP_SIZE 16
+layout(local_size_x = WORKGROUP_SIZE, local_size_y = WORKGROUP_SIZE, local_size_z = 1) in;
+layout(binding = 1) uniform sampler2DArray tex;
+layout(rgba32f, binding = 2) uniform image1D bases;
+layout(binding = 5) uniform sampler2DArray minMaxTex;
+
+struct Lod
+{
+    vec2 align;
+    vec2 pDiff;
+    float scale;
+    int imgIdx;
+    int parentIdx;
+    int lod;
+    uvec4 texelOrigin;
+};
+
+layout(std140, binding = 3) uniform LodData
+{
+    Lod uLods[64];
+};
+
+// one item per z, as in terrain2
+struct Item
+{
+    ivec4 region;
+    int lodIdx;
+    int incremental;
+};
+
+layout(std430, binding = 7) readonly buffer Items
+{
+    Item uItems[];
+};
+
+layout(location = 1) uniform int minMaxLevel;
+
+shared vec2 ranges[WORKGROUP_SIZE * WORKGROUP_SIZE];
+
+// Sets the encoding of a layer before terrain2 generates it: the height range
+// of the parent region it is upsampled from, widened by the detail amplitude.
+void main() {
+    Lod lod = uLods[uItems[gl_WorkGroupID.z].lodIdx];
+    Lod plod = uLods[lod.parentIdx];
+    vec4 pBase = imageLoad(bases, plod.imgIdx);
+
+    // parent cells covering the layer, with one cell of margin for the bicubic filter;
+    // the parent is stored toroidally, shifted by whole cells
+    ivec2 cells = textureSize(minMaxTex, minMaxLevel).xy;
+    ivec2 pShift = ivec2(round(plod.align * vec2(cells)));
+    ivec2 first = clamp(ivec2(floor((.25 + lod.pDiff) * vec2(cells))) - 1, ivec2(0), cells - 1);
+    ivec2 last = clamp(ivec2(floor((.75 + lod.pDiff) * vec2(cells))) + 1, ivec2(0), cells - 1);
+
+    vec2 range = vec2(3.4e38, -3.4e38);
+    for (int y = first.y + int(gl_LocalInvocationID.y); y <= last.y; y += WORKGROUP_SIZE) {
+        for (int x = first.x + int(gl_LocalInvocationID.x); x <= last.x; x += WORKGROUP_SIZE) {
+            ivec2 cell = (ivec2(x, y) + pShift) % cells;
+            vec2 r = texelFetch(minMaxTex, ivec3(cell, plod.imgIdx), minMaxLevel).rg;
+            range = vec2(min(range.x, r.x), max(range.y, r.y));
+        }
+    }
+
+    uint i = gl_LocalInvocationIndex;
+    ranges[i] = range;
+    barrier();
+    for (uint s = WORKGROUP_SIZE * WORKGROUP_SIZE / 2; s > 0; s >>= 1) {
+        if (i < s) {
+            ranges[i] = vec2(min(ranges[i].x, ranges[i + s].x), max(ranges[i].y, ranges[i + s].y));
+        }
+        barrier();
+    }
+
+    if (i == 0) {
+        // same base and detail amplitude as terrain2, with some headroom for the noise
+        float base = texture(tex, vec3(vec2(.5) + plod.align, plod.imgIdx)).r * pBase.z + pBase.w;
+        float amplitude = pow(lod.scale, 0.8) / 16 * 1.1;
+        vec2 r = ranges[0] - base + vec2(-amplitude, amplitude);
+
+        vec4 own = imageLoad(bases, lod.imgIdx);
+        imageStore(bases, lod.imgIdx, vec4(own.xy, max(r.y - r.x, 1e-30), r.x));
+    }
+}
+)GLSL"
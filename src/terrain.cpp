@@ -1,6 +1,10 @@
 #include "terrain.h"
 
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 
 using namespace glm;
 
@@ -14,6 +18,11 @@ static vec4 mod289(vec4 const& x)
     return x - floor(x * (1.0f / 289.0f)) * 289.0f;
 }
 
+static vec4 mod7(vec4 const& x)
+{
+    return x - floor(x * (1.0f / 7.0f)) * 7.0f;
+}
+
 static vec4 permute(vec4 const& x)
 {
     return mod289(((x * 34.0f) + 1.0f) * x);
@@ -24,24 +33,36 @@ static vec4 taylorInvSqrt(vec4 const& r)
     return 1.79284291400159f - 0.85373472095314f * r;
 }
 
-static float snoise(vec3 const& v)
+namespace {
+struct SimplexCorners {
+    // offsets from the four simplex corners
+    vec3 x0, x1, x2, x3;
+
+    // normalized gradients at the four simplex corners
+    vec3 p0, p1, p2, p3;
+};
+}
+
+static SimplexCorners simplexCorners(vec3 const& v)
 {
     const vec2 C = vec2(1.0 / 6.0, 1.0 / 3.0);
     const vec4 D = vec4(0.0, 0.5, 1.0, 2.0);
 
+    SimplexCorners s;
+
     // First corner
     vec3 i = floor(v + dot(v, vec3(C.y)));
-    vec3 x0 = v - i + dot(i, vec3(C.x));
+    s.x0 = v - i + dot(i, vec3(C.x));
 
     // Other corners
-    vec3 g = step(vec3(x0.y, x0.z, x0.x), x0);
+    vec3 g = step(vec3(s.x0.y, s.x0.z, s.x0.x), s.x0);
     vec3 l = 1.0f - g;
     vec3 i1 = min(g, vec3(l.z, l.x, l.y));
     vec3 i2 = max(g, vec3(l.z, l.x, l.y));
 
-    vec3 x1 = x0 - i1 + vec3(C.x);
-    vec3 x2 = x0 - i2 + vec3(C.y);
-    vec3 x3 = x0 - vec3(D.y);
+    s.x1 = s.x0 - i1 + vec3(C.x);
+    s.x2 = s.x0 - i2 + vec3(C.y);
+    s.x3 = s.x0 - vec3(D.y);
 
     // Permutations
     i = mod289(i);
@@ -74,46 +95,227 @@ static float snoise(vec3 const& v)
     vec4 a0 = vec4(b0.x, b0.z, b0.y, b0.w) + vec4(s0.x, s0.z, s0.y, s0.w) * vec4(sh.x, sh.x, sh.y, sh.y);
     vec4 a1 = vec4(b1.x, b1.z, b1.y, b1.w) + vec4(s1.x, s1.z, s1.y, s1.w) * vec4(sh.z, sh.z, sh.w, sh.w);
 
-    vec3 p0 = vec3(a0.x, a0.y, h.x);
-    vec3 p1 = vec3(a0.z, a0.w, h.y);
-    vec3 p2 = vec3(a1.x, a1.y, h.z);
-    vec3 p3 = vec3(a1.z, a1.w, h.w);
+    s.p0 = vec3(a0.x, a0.y, h.x);
+    s.p1 = vec3(a0.z, a0.w, h.y);
+    s.p2 = vec3(a1.x, a1.y, h.z);
+    s.p3 = vec3(a1.z, a1.w, h.w);
 
     //Normalise gradients
-    vec4 norm = taylorInvSqrt(vec4(dot(p0, p0), dot(p1, p1), dot(p2, p2), dot(p3, p3)));
-    p0 *= norm.x;
-    p1 *= norm.y;
-    p2 *= norm.z;
-    p3 *= norm.w;
+    vec4 norm = taylorInvSqrt(vec4(dot(s.p0, s.p0), dot(s.p1, s.p1), dot(s.p2, s.p2), dot(s.p3, s.p3)));
+    s.p0 *= norm.x;
+    s.p1 *= norm.y;
+    s.p2 *= norm.z;
+    s.p3 *= norm.w;
+
+    return s;
+}
+
+static float snoise(vec3 const& v)
+{
+    SimplexCorners s = simplexCorners(v);
 
     // Mix final noise value
-    vec4 m = max(0.6f - vec4(dot(x0, x0), dot(x1, x1), dot(x2, x2), dot(x3, x3)), 0.0f);
+    vec4 m = max(0.6f - vec4(dot(s.x0, s.x0), dot(s.x1, s.x1), dot(s.x2, s.x2), dot(s.x3, s.x3)), 0.0f);
     m = m * m;
-    return 42.0f * dot(m * m, vec4(dot(p0, x0), dot(p1, x1), dot(p2, x2), dot(p3, x3)));
+    return 42.0f * dot(m * m, vec4(dot(s.p0, s.x0), dot(s.p1, s.x1), dot(s.p2, s.x2), dot(s.p3, s.x3)));
+}
+
+float ou::simplexNoise(glm::vec3 const& v)
+{
+    return snoise(v);
+}
+
+float ou::simplexNoise(glm::vec3 const& v, glm::vec3& gradient)
+{
+    SimplexCorners s = simplexCorners(v);
+
+    vec4 m = max(0.6f - vec4(dot(s.x0, s.x0), dot(s.x1, s.x1), dot(s.x2, s.x2), dot(s.x3, s.x3)), 0.0f);
+    vec4 m2 = m * m;
+    vec4 m4 = m2 * m2;
+    vec4 pdotx = vec4(dot(s.p0, s.x0), dot(s.p1, s.x1), dot(s.p2, s.x2), dot(s.p3, s.x3));
+
+    // d(m^4 * pdotx) = -8 m^3 pdotx x + m^4 p
+    vec4 temp = m2 * m * pdotx;
+    gradient = -8.0f * (temp.x * s.x0 + temp.y * s.x1 + temp.z * s.x2 + temp.w * s.x3);
+    gradient += m4.x * s.p0 + m4.y * s.p1 + m4.z * s.p2 + m4.w * s.p3;
+    gradient *= 42.0f;
+
+    return 42.0f * dot(m4, pdotx);
+}
+
+static uvec3 pcg3d(uvec3 v)
+{
+    v = v * 1664525u + 1013904223u;
+    v.x += v.y * v.z;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    v ^= v >> 16u;
+    v.x += v.y * v.z;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    return v;
+}
+
+// pseudo-random gradient in [-1, 1]^3 at a lattice point
+static vec3 latticeGradient(i64vec3 const& cell)
+{
+    uvec3 lo = uvec3(cell);
+    uvec3 hi = uvec3(cell >> std::int64_t(32));
+    uvec3 h = pcg3d(lo + pcg3d(hi));
+    return vec3(h) * (2.0f / 4294967295.0f) - 1.0f;
+}
+
+namespace {
+struct LatticeCorners {
+    // values of the corner gradient ramps, in a b c d e f g h order
+    // with x varying fastest
+    float v[8];
+    vec3 g[8];
+};
 }
 
-static float ridgeNoise(vec3 const& v)
+static LatticeCorners latticeCorners(i64vec3 const& cell, vec3 const& f)
 {
-    return 2.0f * (.5f - abs(0.5f - snoise(v)));
+    LatticeCorners c;
+    for (int i = 0; i < 8; ++i) {
+        i64vec3 corner(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+        c.g[i] = latticeGradient(cell + corner);
+        c.v[i] = dot(c.g[i], f - vec3(corner));
+    }
+    return c;
+}
+
+float ou::hashNoise(glm::i64vec3 const& cell, glm::vec3 const& f)
+{
+    LatticeCorners c = latticeCorners(cell, f);
+    const float *v = c.v;
+
+    vec3 u = f * f * f * (f * (f * 6.0f - 15.0f) + 10.0f);
+    float x0 = v[0] + u.x * (v[1] - v[0]);
+    float x1 = v[2] + u.x * (v[3] - v[2]);
+    float x2 = v[4] + u.x * (v[5] - v[4]);
+    float x3 = v[6] + u.x * (v[7] - v[6]);
+    float y0 = x0 + u.y * (x1 - x0);
+    float y1 = x2 + u.y * (x3 - x2);
+    return y0 + u.z * (y1 - y0);
+}
+
+float ou::hashNoise(glm::i64vec3 const& cell, glm::vec3 const& f, glm::vec3& gradient)
+{
+    LatticeCorners c = latticeCorners(cell, f);
+    const float* v = c.v;
+    const vec3* g = c.g;
+
+    // quintic interpolant and its derivative
+    vec3 u = f * f * f * (f * (f * 6.0f - 15.0f) + 10.0f);
+    vec3 du = 30.0f * f * f * (f * (f - 2.0f) + 1.0f);
+
+    float k4 = v[0] - v[1] - v[2] + v[3];
+    float k5 = v[0] - v[2] - v[4] + v[6];
+    float k6 = v[0] - v[1] - v[4] + v[5];
+    float k7 = -v[0] + v[1] + v[2] - v[3] + v[4] - v[5] - v[6] + v[7];
+
+    vec3 uyzx(u.y, u.z, u.x), uzxy(u.z, u.x, u.y);
+    gradient = g[0] + u.x * (g[1] - g[0]) + u.y * (g[2] - g[0]) + u.z * (g[4] - g[0])
+        + u.x * u.y * (g[0] - g[1] - g[2] + g[3]) + u.y * u.z * (g[0] - g[2] - g[4] + g[6])
+        + u.z * u.x * (g[0] - g[1] - g[4] + g[5]) + u.x * u.y * u.z * (-g[0] + g[1] + g[2] - g[3] + g[4] - g[5] - g[6] + g[7])
+        + du * (vec3(v[1] - v[0], v[2] - v[0], v[4] - v[0]) + uyzx * vec3(k4, k5, k6) + uzxy * vec3(k6, k4, k5) + uyzx * uzxy * k7);
+
+    return v[0] + u.x * (v[1] - v[0]) + u.y * (v[2] - v[0]) + u.z * (v[4] - v[0])
+        + u.x * u.y * k4 + u.y * u.z * k5 + u.z * u.x * k6 + u.x * u.y * u.z * k7;
 }
 
-static float ridgeWithOctaves(vec3 const& v, int n)
+// F1 of cellular2x2x2 in terrain.comp, squared, and the offset from the
+// nearest feature point
+static float cellularSquared(vec3 const& P, vec3& offset)
 {
-    float F = 1;
-    float coeff = 1.0f;
-    for (int i = 0; i < n; ++i) {
-        float t = ridgeNoise(v * coeff) / coeff;
-        t = sign(t) * pow(abs(t), 0.9f);
-        F += t * F;
-        coeff *= 2;
+    const float K = 0.142857142857f; // 1/7
+    const float Ko = 0.428571428571f; // 1/2-K/2
+    const float K2 = 0.020408163265306f; // 1/(7*7)
+    const float Kz = 0.166666666667f; // 1/6
+    const float Kzo = 0.416666666667f; // 1/2-1/6*2
+    const float jitter = 0.8f;
+
+    vec3 Pi = mod289(floor(P));
+    vec3 Pf = fract(P);
+    vec4 Pfx = Pf.x + vec4(0.0, -1.0, 0.0, -1.0);
+    vec4 Pfy = Pf.y + vec4(0.0, 0.0, -1.0, -1.0);
+    vec4 p = permute(Pi.x + vec4(0.0, 1.0, 0.0, 1.0));
+    p = permute(p + Pi.y + vec4(0.0, 0.0, 1.0, 1.0));
+    vec4 p1 = permute(p + Pi.z); // z+0
+    vec4 p2 = permute(p + Pi.z + vec4(1.0)); // z+1
+    vec4 ox1 = fract(p1 * K) - Ko;
+    vec4 oy1 = mod7(floor(p1 * K)) * K - Ko;
+    vec4 oz1 = floor(p1 * K2) * Kz - Kzo; // p1 < 289 guaranteed
+    vec4 ox2 = fract(p2 * K) - Ko;
+    vec4 oy2 = mod7(floor(p2 * K)) * K - Ko;
+    vec4 oz2 = floor(p2 * K2) * Kz - Kzo;
+    vec4 dx1 = Pfx + jitter * ox1;
+    vec4 dy1 = Pfy + jitter * oy1;
+    vec4 dz1 = Pf.z + jitter * oz1;
+    vec4 dx2 = Pfx + jitter * ox2;
+    vec4 dy2 = Pfy + jitter * oy2;
+    vec4 dz2 = Pf.z - 1.0f + jitter * oz2;
+    vec4 d1 = dx1 * dx1 + dy1 * dy1 + dz1 * dz1; // z+0
+    vec4 d2 = dx2 * dx2 + dy2 * dy2 + dz2 * dz2; // z+1
+
+    // sort out only F1, keeping the offset to the nearest feature point
+    vec4 sel = step(d2, d1);
+    d1 = mix(d1, d2, sel);
+    dx1 = mix(dx1, dx2, sel);
+    dy1 = mix(dy1, dy2, sel);
+    dz1 = mix(dz1, dz2, sel);
+
+    float f1 = d1.x;
+    offset = vec3(dx1.x, dy1.x, dz1.x);
+    for (int i = 1; i < 4; ++i) {
+        if (d1[i] < f1) {
+            f1 = d1[i];
+            offset = vec3(dx1[i], dy1[i], dz1[i]);
+        }
     }
-    F = sign(F) * pow(abs(F), 1.3f);
-    return F;
+    return f1;
 }
 
-float ou::terrainElevation(glm::vec3 const& pos)
+float ou::cellularNoise(glm::vec3 const& P)
 {
-    float height = ridgeWithOctaves(pos * 2.0f, 20) - 1.0f;
-    float noise = glm::max(0.0f, height);
-    return noise;
+    vec3 offset;
+    return std::sqrt(cellularSquared(P, offset));
+}
+
+float ou::cellularNoise(glm::vec3 const& P, glm::vec3& gradient)
+{
+    vec3 offset;
+    float f1 = std::sqrt(cellularSquared(P, offset));
+    gradient = offset / std::max(f1, 1e-6f);
+    return f1;
+}
+
+std::string ou::terrainShapeDefines(TerrainShape const& shape, NoiseBasis basis)
+{
+    std::ostringstream defines;
+    defines << std::showpoint << std::setprecision(9);
+    auto sum = [&](char const* name, OctaveSum const& s) {
+        defines << "#define " << name << "_OCTAVES " << s.octaves << "\n"
+                << "#define " << name << "_FREQUENCY " << s.frequency << "\n"
+                << "#define " << name << "_PERSISTENCE " << s.persistence << "\n";
+    };
+    auto value = [&](char const* name, float v) {
+        defines << "#define " << name << " " << v << "\n";
+    };
+
+    sum("RIDGE", shape.ridges);
+    value("RIDGE_SCALE", shape.ridgeScale);
+    value("RIDGE_OFFSET", shape.ridgeOffset);
+    defines << "#define RIDGE_EXPONENT_NUM " << shape.ridgeExponent.num << "\n"
+            << "#define RIDGE_EXPONENT_DEN " << shape.ridgeExponent.den << "\n";
+    sum("MASK", shape.mask);
+    value("MASK_GAIN", shape.maskGain);
+    sum("CELL", shape.cells);
+    value("CELL_SCALE", shape.cellScale);
+    value("CELL_OFFSET", shape.cellOffset);
+    sum("MOUNTAIN", shape.mountains);
+    value("MOUNTAIN_OFFSET", shape.mountainOffset);
+    defines << "#define BASIS " << static_cast<int>(basis) << "\n";
+    return defines.str();
 }
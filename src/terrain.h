@@ -1,11 +1,71 @@
 #ifndef TERRAIN_H
 #define TERRAIN_H
 
+#include <cstdint>
 #include <glm/glm.hpp>
+#include <string>
 
 namespace ou {
 
-float terrainElevation(const glm::vec3& pos);
+enum class NoiseBasis {
+    // simplex noise built on the mod 289 permutation polynomial
+    Simplex,
+
+    // gradient noise over an exact integer lattice, hashed with pcg3d
+    IntegerHash,
+};
+
+float simplexNoise(glm::vec3 const& v);
+
+// gradient noise at frac in [0, 1)^3 inside the given lattice cell
+float hashNoise(glm::i64vec3 const& cell, glm::vec3 const& frac);
+
+// distance to the nearest feature point, F1 of cellular2x2x2 in terrain.comp
+float cellularNoise(glm::vec3 const& v);
+
+// the same noises along with their analytic gradients, as terrain.comp
+// computes them for the gradient layers
+float simplexNoise(glm::vec3 const& v, glm::vec3& gradient);
+float hashNoise(glm::i64vec3 const& cell, glm::vec3 const& frac, glm::vec3& gradient);
+float cellularNoise(glm::vec3 const& v, glm::vec3& gradient);
+
+struct OctaveSum {
+    int octaves;
+    float frequency;
+    float persistence;
+};
+
+// exponent num / den, kept as integers so it can be a template argument
+struct Ratio {
+    int num;
+    int den;
+};
+
+// The top-level terrain: ridges everywhere, and mountains of cells and finer
+// ridges where a low frequency mask lets them through. terrain.comp is
+// compiled with these values, see terrainShapeDefines; the noise presets in
+// terrainnoise.h evaluate them on the CPU.
+struct TerrainShape {
+    OctaveSum ridges;
+    float ridgeScale;
+    float ridgeOffset;
+
+    // ridges of both sums are raised to this power, keeping their sign
+    Ratio ridgeExponent;
+
+    OctaveSum mask;
+    float maskGain;
+
+    OctaveSum cells;
+    float cellScale;
+    float cellOffset;
+
+    OctaveSum mountains;
+    float mountainOffset;
+};
+
+// the shape and basis as #defines for terrain.comp
+std::string terrainShapeDefines(TerrainShape const& shape, NoiseBasis basis);
 }
 
 #endif // TERRAIN_H
@@ -0,0 +1,87 @@
+#include "terrainculling.h"
+#include "planetmath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace ou {
+
+SurfaceBound surfaceBound(int side, glm::dvec2 const& center, double halfSize,
+    double planetRadius, glm::dvec2 const& heightRange)
+{
+    SurfaceBound bound;
+    bound.direction = spherizePoint(center, side);
+    bound.top = planetRadius + heightRange.y;
+    const double bottom = planetRadius + heightRange.x;
+
+    // the corners and edge midpoints at both heights
+    glm::dvec3 lo(std::numeric_limits<double>::infinity());
+    glm::dvec3 hi(-std::numeric_limits<double>::infinity());
+    double minCos = 1.0;
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x) {
+            glm::dvec3 dir = spherizePoint(center + glm::dvec2(x, y) * halfSize, side);
+            minCos = std::min(minCos, glm::dot(dir, bound.direction));
+            lo = glm::min(lo, glm::min(dir * bottom, dir * bound.top));
+            hi = glm::max(hi, glm::max(dir * bottom, dir * bound.top));
+        }
+    }
+    bound.angularRadius = std::acos(glm::clamp(minCos, -1.0, 1.0));
+    bound.center = (lo + hi) * .5;
+
+    // the surface bulges out between the samples by at most the sagitta of
+    // the arc between neighbouring ones
+    double sagitta = bound.top * (1.0 - std::cos(bound.angularRadius));
+    bound.radius = glm::length(hi - lo) * .5 + sagitta;
+    return bound;
+}
+
+Frustum::Frustum(glm::dmat4 const& viewProj)
+{
+    auto row = [&](int i) { return glm::dvec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]); };
+    m_planes = { row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1) };
+    for (glm::dvec4& plane : m_planes) {
+        plane /= glm::length(glm::dvec3(plane));
+    }
+}
+
+bool Frustum::intersects(glm::dvec3 const& center, double radius) const
+{
+    for (glm::dvec4 const& plane : m_planes) {
+        if (glm::dot(glm::dvec3(plane), center) + plane.w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+HorizonCuller::HorizonCuller(glm::dvec3 const& eye, double occluderRadius)
+    : m_direction(glm::normalize(eye))
+    , m_occluderRadius(occluderRadius)
+    , m_horizonAngle(-1.0)
+{
+    double distance = glm::length(eye);
+    if (distance > occluderRadius && occluderRadius > 0.0) {
+        m_horizonAngle = std::acos(occluderRadius / distance);
+    }
+}
+
+bool HorizonCuller::visible(SurfaceBound const& bound) const
+{
+    if (m_horizonAngle < 0.0) {
+        return true;
+    }
+
+    // a point at the top of the terrain rises above the horizon up to this
+    // angle beyond the eye's
+    double beyond = bound.top > m_occluderRadius ? std::acos(m_occluderRadius / bound.top) : 0.0;
+    double angle = std::acos(glm::clamp(glm::dot(m_direction, bound.direction), -1.0, 1.0));
+    return angle - bound.angularRadius < m_horizonAngle + beyond;
+}
+
+double HorizonCuller::horizonAngle() const
+{
+    return m_horizonAngle;
+}
+}
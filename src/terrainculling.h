@@ -0,0 +1,60 @@
+#ifndef TERRAINCULLING_H
+#define TERRAINCULLING_H
+
+#include <array>
+#include <glm/glm.hpp>
+
+namespace ou {
+
+// Bounds of a square of face coordinates on a planet, between the lowest and
+// highest terrain over it. Positions are planet-relative in millimeters.
+struct SurfaceBound {
+    glm::dvec3 center;
+    double radius;
+
+    // direction of the square's center from the planet center, and the
+    // largest angle between it and any point of the square
+    glm::dvec3 direction;
+    double angularRadius;
+
+    // distance of the highest terrain from the planet center
+    double top;
+};
+
+SurfaceBound surfaceBound(int side, glm::dvec2 const& center, double halfSize,
+    double planetRadius, glm::dvec2 const& heightRange);
+
+// the side planes of a view frustum, for points relative to the eye in the
+// space viewProj takes
+class Frustum {
+public:
+    explicit Frustum(glm::dmat4 const& viewProj);
+
+    bool intersects(glm::dvec3 const& center, double radius) const;
+
+private:
+    std::array<glm::dvec4, 4> m_planes;
+};
+
+// Culls what is entirely below the horizon of a sphere of occluderRadius,
+// the lowest terrain of the planet, seen from eye.
+class HorizonCuller {
+public:
+    HorizonCuller(glm::dvec3 const& eye, double occluderRadius);
+
+    bool visible(SurfaceBound const& bound) const;
+
+    // negative if nothing is hidden
+    double horizonAngle() const;
+
+private:
+    glm::dvec3 m_direction;
+    double m_occluderRadius;
+
+    // angle from the eye's direction to its horizon; negative if the eye
+    // is inside the occluder, which then hides nothing
+    double m_horizonAngle;
+};
+}
+
+#endif // TERRAINCULLING_H
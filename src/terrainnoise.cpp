@@ -0,0 +1,61 @@
+#include "terrainnoise.h"
+
+#include <stdexcept>
+
+namespace ou {
+
+namespace {
+    constexpr TerrainShape earthlike = {
+        { 8, 1.0f, 0.8f }, 0.5f, 0.1f, { 1, 1 },
+        { 7, 2.0f, 0.7f }, 30.0f,
+        { 1, 90.0f, 0.6f }, 1.5f, 0.2f,
+        { 11, 10.0f, 0.6f }, 0.5f
+    };
+
+    // few octaves and broad cells, for rolling hills that are cheap to generate
+    constexpr TerrainShape smooth = {
+        { 5, 1.0f, 0.7f }, 0.5f, 0.1f, { 1, 1 },
+        { 4, 2.0f, 0.6f }, 10.0f,
+        { 1, 40.0f, 0.6f }, 0.5f, 0.1f,
+        { 6, 10.0f, 0.5f }, 0.3f
+    };
+
+    // sharper ridges, with more of their fine octaves kept
+    constexpr TerrainShape rugged = {
+        { 10, 1.0f, 0.85f }, 0.6f, 0.1f, { 3, 2 },
+        { 7, 2.0f, 0.7f }, 60.0f,
+        { 2, 60.0f, 0.5f }, 2.0f, 0.2f,
+        { 14, 8.0f, 0.65f }, 0.5f
+    };
+}
+
+template <NoiseBasis Basis, TerrainShape const& Shape>
+static NoisePreset makePreset(std::string name)
+{
+    using Elevation = TerrainElevation<Basis, Shape>;
+    return { std::move(name), Basis, Shape, static_cast<ElevationFunction>(&Elevation::elevation),
+        static_cast<ElevationGradientFunction>(&Elevation::elevation) };
+}
+
+std::vector<NoisePreset> const& noisePresets()
+{
+    // catalogs store the index, so only append
+    static const std::vector<NoisePreset> presets = {
+        makePreset<NoiseBasis::Simplex, earthlike>("earthlike"),
+        makePreset<NoiseBasis::IntegerHash, earthlike>("earthlike-hash"),
+        makePreset<NoiseBasis::Simplex, smooth>("smooth"),
+        makePreset<NoiseBasis::IntegerHash, rugged>("rugged-hash"),
+    };
+    return presets;
+}
+
+NoisePreset const& findNoisePreset(std::string const& name)
+{
+    for (NoisePreset const& preset : noisePresets()) {
+        if (preset.name == name) {
+            return preset;
+        }
+    }
+    throw std::runtime_error("Unknown noise preset " + name);
+}
+}
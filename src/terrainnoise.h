@@ -0,0 +1,255 @@
+#ifndef TERRAINNOISE_H
+#define TERRAINNOISE_H
+
+#include "terrain.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+namespace ou {
+
+// sign(x) * |x|^(Num / Den) and its derivative, with the pow dropped for
+// the common exponents
+template <int Num, int Den>
+struct SignedPow {
+    static float apply(float x)
+    {
+        return std::copysign(std::pow(std::abs(x), float(Num) / float(Den)), x);
+    }
+
+    static float derivative(float x)
+    {
+        const float e = float(Num) / float(Den);
+        return e * std::pow(std::max(std::abs(x), 1e-6f), e - 1.0f);
+    }
+};
+
+template <int N>
+struct SignedPow<N, N> {
+    static float apply(float x) { return x; }
+    static float derivative(float) { return 1.0f; }
+};
+
+template <>
+struct SignedPow<1, 2> {
+    static float apply(float x) { return std::copysign(std::sqrt(std::abs(x)), x); }
+    static float derivative(float x) { return 0.5f / std::sqrt(std::max(std::abs(x), 1e-6f)); }
+};
+
+// One octave of a noise basis, at a position already scaled by its
+// frequency, with or without its gradient with respect to that position.
+template <NoiseBasis Basis>
+struct BasisNoise;
+
+template <>
+struct BasisNoise<NoiseBasis::Simplex> {
+    static float sample(glm::vec3 const& v) { return simplexNoise(v); }
+    static float sample(glm::vec3 const& v, glm::vec3& gradient) { return simplexNoise(v, gradient); }
+};
+
+template <>
+struct BasisNoise<NoiseBasis::IntegerHash> {
+    static float sample(glm::vec3 const& v)
+    {
+        glm::vec3 cell = glm::floor(v);
+        return hashNoise(glm::i64vec3(cell), v - cell);
+    }
+
+    static float sample(glm::vec3 const& v, glm::vec3& gradient)
+    {
+        glm::vec3 cell = glm::floor(v);
+        return hashNoise(glm::i64vec3(cell), v - cell, gradient);
+    }
+};
+
+// ridgeNoise of terrain.comp
+template <NoiseBasis Basis, int Num, int Den>
+struct RidgeNoise {
+    static float sample(glm::vec3 const& v)
+    {
+        float n = BasisNoise<Basis>::sample(v);
+        return SignedPow<Num, Den>::apply(2.0f * (.5f - std::abs(0.5f - n)));
+    }
+
+    static float sample(glm::vec3 const& v, glm::vec3& gradient)
+    {
+        float n = BasisNoise<Basis>::sample(v, gradient);
+        float ridge = 2.0f * (.5f - std::abs(0.5f - n));
+        gradient *= 2.0f * glm::sign(.5f - n) * SignedPow<Num, Den>::derivative(ridge);
+        return SignedPow<Num, Den>::apply(ridge);
+    }
+};
+
+// cubed F1, the cells of octaveWorleyNoise in terrain.comp
+struct CellNoise {
+    static float sample(glm::vec3 const& v)
+    {
+        float n = cellularNoise(v);
+        return n * n * n;
+    }
+
+    static float sample(glm::vec3 const& v, glm::vec3& gradient)
+    {
+        float n = cellularNoise(v, gradient);
+        gradient *= 3.0f * n * n;
+        return n * n * n;
+    }
+};
+
+template <int Octaves>
+float octaveAmplitude(float persistence)
+{
+    return persistence == 1.0f
+        ? float(Octaves)
+        : (1.0f - std::pow(persistence, float(Octaves))) / (1.0f - persistence);
+}
+
+// Octave sum of terrain.comp with the octave count fixed at compile time, so
+// the loop has a constant trip count and the normalization folds to a
+// constant. Octaves fade out from half of maxFreq and stop past it.
+template <int Octaves, typename Noise>
+float octaveSum(glm::vec3 const& pos, float freq, float persistence, float maxFreq)
+{
+    float total = 0.0f;
+    float amplitude = 1.0f;
+    for (int i = 0; i < Octaves; ++i) {
+        float weight = 1.0f - glm::smoothstep(0.5f * maxFreq, maxFreq, freq);
+        if (weight <= 0.0f) {
+            break;
+        }
+
+        total += Noise::sample(pos * freq) * amplitude * weight;
+        freq *= 2.0f;
+        amplitude *= persistence;
+    }
+    return total / octaveAmplitude<Octaves>(persistence);
+}
+
+// the same along with its gradient with respect to pos
+template <int Octaves, typename Noise>
+float octaveSum(glm::vec3 const& pos, float freq, float persistence, float maxFreq, glm::vec3& gradient)
+{
+    float total = 0.0f;
+    float amplitude = 1.0f;
+    gradient = glm::vec3(0.0f);
+    for (int i = 0; i < Octaves; ++i) {
+        float weight = 1.0f - glm::smoothstep(0.5f * maxFreq, maxFreq, freq);
+        if (weight <= 0.0f) {
+            break;
+        }
+
+        glm::vec3 g;
+        total += Noise::sample(pos * freq, g) * amplitude * weight;
+        gradient += g * (freq * amplitude * weight);
+        freq *= 2.0f;
+        amplitude *= persistence;
+    }
+
+    float maxAmplitude = octaveAmplitude<Octaves>(persistence);
+    gradient /= maxAmplitude;
+    return total / maxAmplitude;
+}
+
+// The top-level elevation of terrain.comp for one basis and shape, with the
+// octave counts and the ridge exponent as template arguments.
+template <NoiseBasis Basis, TerrainShape const& Shape>
+struct TerrainElevation {
+    using Ridge = RidgeNoise<Basis, Shape.ridgeExponent.num, Shape.ridgeExponent.den>;
+
+    static float elevation(glm::vec3 const& direction, float maxFreq)
+    {
+        glm::vec3 pos = glm::normalize(direction);
+
+        float height = octaveSum<Shape.ridges.octaves, Ridge>(
+                           pos, Shape.ridges.frequency, Shape.ridges.persistence, maxFreq)
+                * Shape.ridgeScale
+            + Shape.ridgeOffset;
+
+        float n = octaveSum<Shape.mask.octaves, BasisNoise<Basis>>(
+            pos, Shape.mask.frequency, Shape.mask.persistence, maxFreq);
+        float mul = glm::clamp(n * n * n * Shape.maskGain, 0.0f, 1.0f);
+
+        float mountains = octaveSum<Shape.cells.octaves, CellNoise>(
+                              pos, Shape.cells.frequency, Shape.cells.persistence, maxFreq)
+                * Shape.cellScale
+            + Shape.cellOffset;
+        mountains += octaveSum<Shape.mountains.octaves, Ridge>(
+                         pos, Shape.mountains.frequency, Shape.mountains.persistence, maxFreq)
+            + Shape.mountainOffset;
+
+        return height + mul * mountains;
+    }
+
+    // the same along with its gradient with respect to the point on the unit
+    // sphere, which terrain.comp stores in the gradient layers
+    static float elevation(glm::vec3 const& direction, float maxFreq, glm::vec3& gradient)
+    {
+        glm::vec3 pos = glm::normalize(direction);
+        glm::vec3 g;
+
+        float height = octaveSum<Shape.ridges.octaves, Ridge>(
+                           pos, Shape.ridges.frequency, Shape.ridges.persistence, maxFreq, g)
+                * Shape.ridgeScale
+            + Shape.ridgeOffset;
+        gradient = g * Shape.ridgeScale;
+
+        float n = octaveSum<Shape.mask.octaves, BasisNoise<Basis>>(
+            pos, Shape.mask.frequency, Shape.mask.persistence, maxFreq, g);
+        float mul = n * n * n * Shape.maskGain;
+        glm::vec3 dMul = (mul > 0.0f && mul < 1.0f) ? 3.0f * Shape.maskGain * n * n * g : glm::vec3(0.0f);
+        mul = glm::clamp(mul, 0.0f, 1.0f);
+
+        float mountains = octaveSum<Shape.cells.octaves, CellNoise>(
+                              pos, Shape.cells.frequency, Shape.cells.persistence, maxFreq, g)
+                * Shape.cellScale
+            + Shape.cellOffset;
+        glm::vec3 dMountains = g * Shape.cellScale;
+        mountains += octaveSum<Shape.mountains.octaves, Ridge>(
+                         pos, Shape.mountains.frequency, Shape.mountains.persistence, maxFreq, g)
+            + Shape.mountainOffset;
+        dMountains += g;
+
+        gradient += dMul * mountains + mul * dMountains;
+        return height + mul * mountains;
+    }
+};
+
+using ElevationFunction = float (*)(glm::vec3 const& direction, float maxFreq);
+using ElevationGradientFunction = float (*)(glm::vec3 const& direction, float maxFreq, glm::vec3& gradient);
+
+// A kind of planet terrain: terrain.comp is compiled with the shape and basis,
+// and elevation evaluates the same on the CPU.
+struct NoisePreset {
+    std::string name;
+    NoiseBasis basis;
+    TerrainShape shape;
+    ElevationFunction elevation;
+    ElevationGradientFunction elevationGradient;
+};
+
+// the presets planets choose from by index; the first is the default
+std::vector<NoisePreset> const& noisePresets();
+
+// throws if there is no preset of that name
+NoisePreset const& findNoisePreset(std::string const& name);
+
+// elevation of the top-level layers in a direction from the planet center,
+// as terrain.comp generates it; octaves above maxFreq are cut the same way
+inline float topLevelElevation(glm::vec3 const& direction, NoisePreset const& preset, float maxFreq)
+{
+    return preset.elevation(direction, maxFreq);
+}
+
+// the same along with its analytic gradient with respect to the point on the
+// unit sphere, for normals without extra samples
+inline float topLevelElevation(glm::vec3 const& direction, NoisePreset const& preset, float maxFreq, glm::vec3& gradient)
+{
+    return preset.elevationGradient(direction, maxFreq, gradient);
+}
+}
+
+#endif // TERRAINNOISE_H
@@ -0,0 +1,298 @@
+#include "terrainpyramid.h"
+#include "planetmath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace ou {
+
+// texel coordinates within a layer's window <-> layer-local [-1, 1] coordinates,
+// same texture mapping as the planet vertex shader
+static glm::dvec2 localToTexel(glm::dvec2 const& local, int textureSize)
+{
+    return (local + 1.0) * .5 * static_cast<double>(textureSize);
+}
+
+static double texelToLocal(double texel, int textureSize)
+{
+    return texel / textureSize * 2 - 1;
+}
+
+void TerrainPyramid::setRadius(std::int64_t radius)
+{
+    m_radius = static_cast<double>(radius);
+}
+
+void TerrainPyramid::setLayer(int layer, int side, int lod, glm::dvec2 center, double scale,
+    int textureSize, int size, std::vector<glm::dvec2> leaves)
+{
+    if (layer >= int(m_layers.size())) {
+        m_layers.resize(layer + 1);
+    }
+
+    Layer& l = m_layers[layer];
+    l.side = side;
+    l.lod = lod;
+    l.center = center;
+    l.scale = scale;
+    l.textureSize = textureSize;
+    l.size = size;
+    l.levels.clear();
+    l.levels.push_back(std::move(leaves));
+
+    // reduce down to a single node
+    for (int n = size / 2; n >= 1; n /= 2) {
+        std::vector<glm::dvec2> const& src = l.levels.back();
+        std::vector<glm::dvec2> dst(n * n);
+        for (int y = 0; y < n; ++y) {
+            for (int x = 0; x < n; ++x) {
+                glm::dvec2 a = src[(y * 2) * n * 2 + x * 2];
+                glm::dvec2 b = src[(y * 2) * n * 2 + x * 2 + 1];
+                glm::dvec2 c = src[(y * 2 + 1) * n * 2 + x * 2];
+                glm::dvec2 d = src[(y * 2 + 1) * n * 2 + x * 2 + 1];
+                dst[y * n + x] = { std::min({ a.x, b.x, c.x, d.x }), std::max({ a.y, b.y, c.y, d.y }) };
+            }
+        }
+        l.levels.push_back(std::move(dst));
+    }
+
+    // height range over all layers bounds the shell that rays are marched through
+    bool first = true;
+    for (Layer const& other : m_layers) {
+        if (other.levels.empty()) {
+            continue;
+        }
+        glm::dvec2 root = other.levels.back()[0];
+        m_range = first ? root : glm::dvec2(std::min(m_range.x, root.x), std::max(m_range.y, root.y));
+        first = false;
+    }
+}
+
+TerrainPyramid::Layer const* TerrainPyramid::coveringLayer(int side, glm::dvec2 const& pos) const
+{
+    Layer const* result = nullptr;
+    for (Layer const& layer : m_layers) {
+        if (layer.levels.empty() || layer.side != side || (result && result->lod >= layer.lod)) {
+            continue;
+        }
+
+        // a few texels in from the layer's edges, except where an edge is on
+        // or past the face edge, which the neighbouring face's layers continue
+        const double inf = std::numeric_limits<double>::infinity();
+        double margin = 4.0 / layer.textureSize * layer.scale;
+        glm::dvec2 lo = layer.center - layer.scale;
+        glm::dvec2 hi = layer.center + layer.scale;
+        lo = glm::dvec2(lo.x <= -1 ? -inf : lo.x + margin, lo.y <= -1 ? -inf : lo.y + margin);
+        hi = glm::dvec2(hi.x >= 1 ? inf : hi.x - margin, hi.y >= 1 ? inf : hi.y - margin);
+        if (pos.x >= lo.x && pos.x <= hi.x && pos.y >= lo.y && pos.y <= hi.y) {
+            result = &layer;
+        }
+    }
+    return result;
+}
+
+TerrainRayHit TerrainPyramid::raycast(glm::dvec3 const& origin, glm::dvec3 const& direction,
+    double maxDistance) const
+{
+    TerrainRayHit result;
+    if (m_layers.empty() || m_radius <= 0.0) {
+        return result;
+    }
+
+    glm::dvec3 dir = glm::normalize(direction);
+
+    // clip the ray against the sphere of the highest terrain
+    double outer = m_radius + m_range.y;
+    double b = glm::dot(origin, dir);
+    double c = glm::dot(origin, origin) - outer * outer;
+    double disc = b * b - c;
+    if (disc < 0.0) {
+        return result;
+    }
+    double sq = std::sqrt(disc);
+    double t = std::max(-b - sq, 0.0);
+    double tEnd = std::min(-b + sq, maxDistance);
+
+    // every step advances at least half a leaf (see below), and a unit of face
+    // coordinates spans more than a quarter of the radius on the surface, so
+    // the finest leaves bound the steps a ray of this length can take
+    double finestLeaf = std::numeric_limits<double>::infinity();
+    for (Layer const& layer : m_layers) {
+        if (!layer.levels.empty()) {
+            finestLeaf = std::min(finestLeaf, 2.0 * layer.scale / layer.size);
+        }
+    }
+    const double minStep = std::max(.5 * finestLeaf * .25 * m_radius, 1.0);
+    const double maxSteps = std::ceil((tEnd - t) / minStep) + 1.0;
+
+    // the layer and leaf under a point of the ray, and whether the point is
+    // below the leaf's surface; no layer leaves the ray undecided
+    struct Sample {
+        Layer const* layer;
+        CubeCoords cube;
+        glm::dvec2 local;
+        glm::dvec2 leaf;
+        double altitude;
+        bool below;
+    };
+    auto sample = [&](double t) {
+        Sample s;
+        glm::dvec3 p = origin + dir * t;
+        double r = glm::length(p);
+        s.altitude = r - m_radius;
+        s.cube = cubizePoint(p / r);
+        s.layer = coveringLayer(s.cube.side, s.cube.pos);
+        s.below = false;
+        if (!s.layer) {
+            return s;
+        }
+
+        s.local = (s.cube.pos - s.layer->center) / s.layer->scale;
+        glm::dvec2 texel = localToTexel(s.local, s.layer->textureSize);
+        int leafCount = s.layer->size;
+        s.leaf = texel / (double(s.layer->textureSize) / leafCount);
+
+        glm::ivec2 leafIdx = glm::clamp(glm::ivec2(glm::floor(s.leaf)), 0, leafCount - 1);
+        glm::dvec2 leafRange = s.layer->levels[0][leafIdx.y * leafCount + leafIdx.x];
+        s.below = s.altitude <= (leafRange.x + leafRange.y) * .5;
+        return s;
+    };
+
+    double tPrev = t;
+    for (double step = 0; step < maxSteps && t <= tEnd; ++step) {
+        Sample s = sample(t);
+        if (!s.layer) {
+            return result;
+        }
+
+        // hit if below the surface of the leaf under the ray, at the crossing
+        // bisected between this point and the last one above
+        if (s.below) {
+            double lo = tPrev;
+            for (int i = 0; i < 64 && t - lo > 1.0; ++i) {
+                double mid = (lo + t) * .5;
+                Sample m = sample(mid);
+                if (m.layer && m.below) {
+                    t = mid;
+                } else {
+                    lo = mid;
+                }
+            }
+            result.hit = true;
+            result.distance = t;
+            result.position = origin + dir * t;
+            return result;
+        }
+        tPrev = t;
+
+        Layer const* layer = s.layer;
+        glm::dvec2 const& local = s.local;
+        glm::dvec2 const& leaf = s.leaf;
+        double altitude = s.altitude;
+        double rate = glm::dot(dir, origin + dir * t) / (m_radius + altitude);
+        int leafCount = layer->size;
+        double leafTexels = double(layer->textureSize) / leafCount;
+
+        // conservative millimeters on the surface per unit of face coordinates
+        FirstOrderDerivatives drivs = derivatives(s.cube.pos, s.cube.side);
+        double stretch = .5 * std::min(glm::length(drivs.fx), glm::length(drivs.fy)) * m_radius;
+
+        // the largest step the nodes of some level allow: the ray may not leave
+        // the 3x3 block around its node, nor come near a node in the block while
+        // below its surface; the altitude along a ray is convex, so its tangent
+        // is a lower bound
+        double advance = 0.0;
+        for (int level = int(layer->levels.size()) - 1; level >= 0; --level) {
+            int n = leafCount >> level;
+            double nodeSize = double(1 << level);
+            glm::ivec2 node = glm::clamp(glm::ivec2(glm::floor(leaf / nodeSize)), 0, n - 1);
+            glm::ivec2 first = glm::max(node - 1, 0);
+            glm::ivec2 last = glm::min(node + 1, n - 1);
+
+            auto toLocal = [&](glm::ivec2 idx) {
+                glm::dvec2 texels = glm::dvec2(idx) * nodeSize * leafTexels;
+                return glm::dvec2(texelToLocal(texels.x, layer->textureSize), texelToLocal(texels.y, layer->textureSize));
+            };
+
+            glm::dvec2 toEdge = glm::min(local - toLocal(first), toLocal(last + 1) - local);
+            double safe = std::max(std::min(toEdge.x, toEdge.y), 0.0) * layer->scale * stretch;
+
+            for (int y = first.y; y <= last.y && safe > 0.0; ++y) {
+                for (int x = first.x; x <= last.x; ++x) {
+                    glm::dvec2 range = layer->levels[level][y * n + x];
+                    double surface = level == 0 ? (range.x + range.y) * .5 : range.y;
+
+                    double above = std::numeric_limits<double>::infinity();
+                    if (altitude <= surface) {
+                        above = 0.0;
+                    } else if (rate < 0.0) {
+                        above = (altitude - surface) / -rate;
+                    }
+
+                    glm::dvec2 lo = toLocal({ x, y });
+                    glm::dvec2 hi = toLocal({ x + 1, y + 1 });
+                    glm::dvec2 outside = glm::max(glm::max(lo - local, local - hi), 0.0);
+                    double distance = glm::length(outside) * layer->scale * stretch;
+
+                    safe = std::min(safe, std::max(distance, above));
+                }
+            }
+
+            advance = std::max(advance, safe);
+        }
+
+        // at least half a leaf, the resolution of hits anyway; near face edges
+        // the blocks end at the edge and would only allow ever shorter steps
+        double leafStep = layer->scale / leafCount * stretch;
+        t += std::max({ advance, leafStep, 1.0, t * 1e-9 });
+    }
+
+    return result;
+}
+
+bool TerrainPyramid::heightRange(int side, glm::dvec2 const& center, double halfSize, glm::dvec2& range) const
+{
+    Layer const* layer = nullptr;
+    for (Layer const& l : m_layers) {
+        if (l.levels.empty() || l.side != side || (layer && layer->lod >= l.lod)) {
+            continue;
+        }
+        glm::dvec2 local = glm::abs(center - l.center) + halfSize;
+        if (local.x <= l.scale && local.y <= l.scale) {
+            layer = &l;
+        }
+    }
+    if (!layer) {
+        bool arrived = std::any_of(m_layers.begin(), m_layers.end(), [](Layer const& l) { return !l.levels.empty(); });
+        range = m_range;
+        return arrived;
+    }
+
+    // leaves under the square, read from the level where it spans at most two nodes
+    double leafTexels = double(layer->textureSize) / layer->size;
+    glm::dvec2 lo = localToTexel((center - halfSize - layer->center) / layer->scale, layer->textureSize) / leafTexels;
+    glm::dvec2 hi = localToTexel((center + halfSize - layer->center) / layer->scale, layer->textureSize) / leafTexels;
+    int level = 0;
+    while (level + 1 < int(layer->levels.size()) && (hi.x - lo.x) / (1 << level) > 1.0) {
+        ++level;
+    }
+
+    int n = layer->size >> level;
+    glm::ivec2 first = glm::clamp(glm::ivec2(glm::floor(lo / double(1 << level))), 0, n - 1);
+    glm::ivec2 last = glm::clamp(glm::ivec2(glm::floor(hi / double(1 << level))), 0, n - 1);
+    range = { std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity() };
+    for (int y = first.y; y <= last.y; ++y) {
+        for (int x = first.x; x <= last.x; ++x) {
+            glm::dvec2 node = layer->levels[level][y * n + x];
+            range = { std::min(range.x, node.x), std::max(range.y, node.y) };
+        }
+    }
+    return true;
+}
+
+glm::dvec2 TerrainPyramid::range() const
+{
+    return m_range;
+}
+}
@@ -0,0 +1,66 @@
+#ifndef TERRAINPYRAMID_H
+#define TERRAINPYRAMID_H
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace ou {
+
+struct TerrainRayHit {
+    bool hit = false;
+
+    // along the ray, in millimeters
+    double distance = 0.0;
+
+    // planet-relative, in millimeters
+    glm::dvec3 position{};
+};
+
+// CPU copy of the min/max height pyramid of each generated terrain layer.
+// Leaves cover a tile of heightmap texels; the surface is taken as the
+// middle of a leaf's height range, so hits are accurate to a leaf of the
+// finest layer covering them.
+class TerrainPyramid {
+public:
+    void setRadius(std::int64_t radius);
+
+    // leaves are size * size (min, max) pairs in millimeters above the
+    // radius, row-major; textureSize is the heightmap size of the layer
+    void setLayer(int layer, int side, int lod, glm::dvec2 center, double scale,
+        int textureSize, int size, std::vector<glm::dvec2> leaves);
+
+    // origin is planet-relative in the planet's rotating frame, in millimeters;
+    // misses if the ray leaves before maxDistance or no layer has arrived yet
+    TerrainRayHit raycast(glm::dvec3 const& origin, glm::dvec3 const& direction,
+        double maxDistance) const;
+
+    // (min, max) height over the square of face coordinates center +- halfSize,
+    // from the finest layer covering it; false if no layer has arrived yet
+    bool heightRange(int side, glm::dvec2 const& center, double halfSize, glm::dvec2& range) const;
+
+    // (min, max) height over all layers
+    glm::dvec2 range() const;
+
+private:
+    struct Layer {
+        int side = -1;
+        int lod = 0;
+        glm::dvec2 center{};
+        double scale = 1.0;
+        int textureSize = 0;
+        int size = 0;
+
+        // levels[0] holds the leaves, each next level halves the size
+        std::vector<std::vector<glm::dvec2>> levels;
+    };
+
+    Layer const* coveringLayer(int side, glm::dvec2 const& pos) const;
+
+    double m_radius = 0.0;
+    glm::dvec2 m_range{ 0.0, 0.0 };
+    std::vector<Layer> m_layers;
+};
+}
+
+#endif // TERRAINPYRAMID_H
@@ -0,0 +1,102 @@
+#include "terrainquadtree.h"
+#include "terrainpyramid.h"
+
+#include <algorithm>
+
+namespace ou {
+
+TerrainQuadtree::TerrainQuadtree(QuadtreeView const& view, std::vector<QuadtreeLayer> const& layers,
+    TerrainPyramid const& pyramid)
+    : m_view(view)
+    , m_layers(layers)
+    , m_pyramid(pyramid)
+    , m_frustum(view.viewProj)
+    , m_horizon(view.eye, view.occluderRadius)
+{
+}
+
+std::vector<QuadtreeNode> TerrainQuadtree::select()
+{
+    m_stats = {};
+
+    std::vector<QuadtreeNode> nodes;
+    for (int side = 0; side < 6; ++side) {
+        visit(side, 0, { 0, 0 }, 1.0, nodes);
+    }
+    return nodes;
+}
+
+TerrainQuadtree::Stats const& TerrainQuadtree::stats() const
+{
+    return m_stats;
+}
+
+int TerrainQuadtree::finestLayer(int side, glm::dvec2 const& center, double scale) const
+{
+    int result = -1;
+    for (int i = 0; i < int(m_layers.size()); ++i) {
+        QuadtreeLayer const& l = m_layers[i];
+        if (l.side != side || (result >= 0 && m_layers[result].lod >= l.lod)) {
+            continue;
+        }
+        glm::dvec2 extent = glm::abs(center - l.center) + scale;
+        if (extent.x <= l.scale * (1 + 1e-9) && extent.y <= l.scale * (1 + 1e-9)) {
+            result = i;
+        }
+    }
+    return result;
+}
+
+void TerrainQuadtree::visit(int side, int depth, glm::dvec2 const& center, double scale,
+    std::vector<QuadtreeNode>& nodes)
+{
+    ++m_stats.visited;
+
+    int layer = finestLayer(side, center, scale);
+    if (layer < 0) {
+        return;
+    }
+
+    glm::dvec2 heights;
+    bool bounded = m_pyramid.heightRange(side, center, scale, heights);
+    if (!bounded) {
+        heights = { 0.0, 0.0 };
+    }
+    SurfaceBound bound = surfaceBound(side, center, scale, m_view.planetRadius, heights);
+
+    if (bounded) {
+        if (!m_horizon.visible(bound)) {
+            ++m_stats.horizonCulled;
+            return;
+        }
+        glm::dvec3 relative = (bound.center - m_view.eye) / m_view.unit;
+        if (!m_frustum.intersects(relative, bound.radius / m_view.unit)) {
+            ++m_stats.frustumCulled;
+            return;
+        }
+    }
+
+    // a face spans a quarter turn over two units of face coordinates
+    const double quarterTurn = 1.5707963267948966;
+    double spacing = scale * quarterTurn * bound.top / m_view.gridSize;
+    double distance = std::max(glm::length(bound.center - m_view.eye) - bound.radius, 1.0);
+    bool coarse = spacing / distance * m_view.pixelsPerRadian > m_view.maxPixelError;
+
+    bool split = coarse && depth < m_view.maxDepth;
+    const glm::dvec2 corners[4] = { { -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 } };
+    for (int i = 0; i < 4 && split; ++i) {
+        glm::dvec2 childCenter = center + corners[i] * scale * .5;
+        int childLayer = finestLayer(side, childCenter, scale * .5);
+        split = childLayer >= 0
+            && m_view.textureSize * scale * .5 / m_layers[childLayer].scale >= m_view.gridSize;
+    }
+
+    if (!split) {
+        nodes.push_back({ side, depth, center, scale, layer, m_layers[layer].lod });
+        return;
+    }
+    for (glm::dvec2 const& corner : corners) {
+        visit(side, depth + 1, center + corner * scale * .5, scale * .5, nodes);
+    }
+}
+}
@@ -0,0 +1,88 @@
+#ifndef TERRAINQUADTREE_H
+#define TERRAINQUADTREE_H
+
+#include "terrainculling.h"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace ou {
+
+class TerrainPyramid;
+
+// a generated layer that nodes can take their heights from, covering the
+// face coordinates center +- scale
+struct QuadtreeLayer {
+    int side;
+    int lod;
+    glm::dvec2 center;
+    double scale;
+};
+
+// a node to render, covering the face coordinates center +- scale, with the
+// heights of layers[layer], which is of the given lod
+struct QuadtreeNode {
+    int side;
+    int depth;
+    glm::dvec2 center;
+    double scale;
+    int layer;
+    int lod;
+};
+
+struct QuadtreeView {
+    // planet-relative in the planet's rotating frame, in millimeters
+    glm::dvec3 eye;
+
+    // takes eye-relative positions in the planet's frame, in units of unit
+    glm::dmat4 viewProj;
+    double unit;
+
+    double planetRadius;
+
+    // radius of the lowest terrain, which hides what is behind its horizon
+    double occluderRadius;
+
+    double pixelsPerRadian;
+    double maxPixelError;
+    int gridSize;
+    int textureSize;
+    int maxDepth;
+};
+
+// Chunked LOD over the six faces of a planet, as an alternative to the rings
+// of layers around the camera. A node splits into four while the spacing of
+// its grid appears larger than maxPixelError and its children still get a
+// texel per grid cell from the finest layer covering them. Nodes outside the
+// frustum or below the horizon are dropped along with their subtrees; both
+// tests bound the nodes with the height ranges of the terrain pyramid, and
+// are skipped until it has any.
+class TerrainQuadtree {
+public:
+    struct Stats {
+        int visited = 0;
+        int frustumCulled = 0;
+        int horizonCulled = 0;
+    };
+
+    TerrainQuadtree(QuadtreeView const& view, std::vector<QuadtreeLayer> const& layers,
+        TerrainPyramid const& pyramid);
+
+    std::vector<QuadtreeNode> select();
+
+    Stats const& stats() const;
+
+private:
+    void visit(int side, int depth, glm::dvec2 const& center, double scale, std::vector<QuadtreeNode>& nodes);
+    int finestLayer(int side, glm::dvec2 const& center, double scale) const;
+
+    QuadtreeView m_view;
+    std::vector<QuadtreeLayer> const& m_layers;
+    TerrainPyramid const& m_pyramid;
+    Frustum m_frustum;
+    HorizonCuller m_horizon;
+    Stats m_stats;
+};
+}
+
+#endif // TERRAINQUADTREE_H
@@ -0,0 +1,98 @@
+#include "terrainscheduler.h"
+
+#include <algorithm>
+
+namespace ou {
+
+void TerrainScheduler::request(TerrainJob const& job)
+{
+    auto it = std::find_if(m_jobs.begin(), m_jobs.end(),
+        [&](TerrainJob const& pending) { return pending.lod == job.lod && pending.prefetch == job.prefetch; });
+    if (it != m_jobs.end()) {
+        *it = job;
+    } else {
+        m_jobs.push_back(job);
+    }
+}
+
+void TerrainScheduler::cancel(int lod, bool prefetch)
+{
+    m_jobs.erase(std::remove_if(m_jobs.begin(), m_jobs.end(),
+                     [&](TerrainJob const& job) { return job.lod == lod && job.prefetch == prefetch; }),
+        m_jobs.end());
+}
+
+void TerrainScheduler::truncate(int lods)
+{
+    m_jobs.erase(std::remove_if(m_jobs.begin(), m_jobs.end(),
+                     [&](TerrainJob const& job) { return job.lod >= lods; }),
+        m_jobs.end());
+}
+
+void TerrainScheduler::beginFrame(double budget)
+{
+    m_remaining = budget;
+    m_issued = 0;
+}
+
+bool TerrainScheduler::next(std::function<bool(TerrainJob const&)> const& ready, TerrainJob& job)
+{
+    if (m_jobs.empty() || (m_issued > 0 && m_remaining < m_costEstimate)) {
+        return false;
+    }
+
+    // finest first, so importance lent to a parent passes on to its own parent
+    std::sort(m_jobs.begin(), m_jobs.end(),
+        [](TerrainJob const& a, TerrainJob const& b) { return a.lod > b.lod; });
+
+    std::vector<double> priority(m_jobs.size());
+    std::vector<bool> runnable(m_jobs.size());
+    for (std::size_t i = 0; i < m_jobs.size(); ++i) {
+        priority[i] = std::max(priority[i], m_jobs[i].importance);
+        runnable[i] = ready(m_jobs[i]);
+        if (runnable[i]) {
+            continue;
+        }
+
+        for (std::size_t j = i + 1; j < m_jobs.size() && m_jobs[j].lod >= m_jobs[i].lod - 1; ++j) {
+            if (m_jobs[j].lod == m_jobs[i].lod - 1) {
+                priority[j] = std::max(priority[j], priority[i]);
+            }
+        }
+    }
+
+    // ties go to the finer lod, which comes first
+    int best = -1;
+    for (std::size_t i = 0; i < m_jobs.size(); ++i) {
+        if (runnable[i] && (best < 0 || priority[i] > priority[best])) {
+            best = static_cast<int>(i);
+        }
+    }
+    if (best < 0) {
+        return false;
+    }
+
+    job = m_jobs[best];
+    m_jobs.erase(m_jobs.begin() + best);
+    m_remaining -= m_costEstimate;
+    ++m_issued;
+    return true;
+}
+
+void TerrainScheduler::recordCost(double milliseconds, int count)
+{
+    if (count > 0) {
+        m_costEstimate += (milliseconds / count - m_costEstimate) * 0.25;
+    }
+}
+
+double TerrainScheduler::costEstimate() const
+{
+    return m_costEstimate;
+}
+
+std::size_t TerrainScheduler::pendingCount() const
+{
+    return m_jobs.size();
+}
+}
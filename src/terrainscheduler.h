@@ -0,0 +1,63 @@
+#ifndef TERRAINSCHEDULER_H
+#define TERRAINSCHEDULER_H
+
+#include <functional>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace ou {
+
+// generation of the layer of a lod around the given snap position
+struct TerrainJob {
+    int lod;
+    glm::i64vec2 snapNums;
+
+    // angle the detail that is missing or misplaced without this job
+    // subtends from the camera; more important jobs run first
+    double importance;
+
+    // generated into a spare layer ahead of the camera instead of the lod's own
+    bool prefetch = false;
+};
+
+// Pending terrain layer generation of a planet.
+// Camera movement and prefetching request jobs here; lods whose layers the
+// pool reclaimed are missing again and get requested like new ones. Each
+// frame the render system runs the most important jobs whose parents are
+// ready until the frame's GPU time budget is spent. The cost of a job is
+// learned from timer queries around the generation dispatches.
+class TerrainScheduler {
+public:
+    // queue a job, replacing the pending job of the same lod and kind
+    void request(TerrainJob const& job);
+
+    // drop the pending job of a lod that no longer needs it
+    void cancel(int lod, bool prefetch = false);
+
+    // drop the pending jobs of lods at or above lods
+    void truncate(int lods);
+
+    // start a frame with budget milliseconds of generation time
+    void beginFrame(double budget);
+
+    // take the most important job for which ready returns true, as long as
+    // the budget allows another one; at least one job runs every frame.
+    // Jobs waiting for their parent lend their importance to the jobs of
+    // the parent lod.
+    bool next(std::function<bool(TerrainJob const&)> const& ready, TerrainJob& job);
+
+    // fold the measured GPU time of count jobs into the cost estimate
+    void recordCost(double milliseconds, int count);
+
+    double costEstimate() const;
+    std::size_t pendingCount() const;
+
+private:
+    std::vector<TerrainJob> m_jobs;
+    double m_costEstimate = 1.0;
+    double m_remaining = 0.0;
+    int m_issued = 0;
+};
+}
+
+#endif // TERRAINSCHEDULER_H
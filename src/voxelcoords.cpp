@@ -2,19 +2,60 @@
 
 namespace ou {
 
-VoxelCoords VoxelCoords::operator-(const VoxelCoords& other) const
-{
-    auto diffLow = glm::u64vec3(pos) - glm::u64vec3(other.pos);
-    auto diffHigh = glm::u64vec3(voxel) - glm::u64vec3(other.voxel);
+namespace {
+    const double voxelSize = 18446744073709551616.0; // 2^64 mm
+
+    // Carry into the voxel when adding or subtracting the signed low parts
+    // overflowed, +1 or -1 depending on the sign of the first operand. Only
+    // integer operations, so that the batch loops vectorize.
+    inline std::uint64_t carry(std::uint64_t overflow, std::uint64_t first)
+    {
+        overflow >>= 63;
+        return overflow - 2 * (overflow & (first >> 63));
+    }
 
-    // TODO: take care of underflows
+    inline void addComponent(std::int64_t aHigh, std::int64_t aLow, std::int64_t bHigh, std::int64_t bLow,
+        std::int64_t& high, std::int64_t& low)
+    {
+        std::uint64_t a = static_cast<std::uint64_t>(aLow), b = static_cast<std::uint64_t>(bLow);
+        std::uint64_t sum = a + b;
+        std::uint64_t c = carry((a ^ sum) & (b ^ sum), a);
+        high = static_cast<std::int64_t>(static_cast<std::uint64_t>(aHigh) + static_cast<std::uint64_t>(bHigh) + c);
+        low = static_cast<std::int64_t>(sum);
+    }
+
+    inline void subtractComponent(std::int64_t aHigh, std::int64_t aLow, std::int64_t bHigh, std::int64_t bLow,
+        std::int64_t& high, std::int64_t& low)
+    {
+        std::uint64_t a = static_cast<std::uint64_t>(aLow), b = static_cast<std::uint64_t>(bLow);
+        std::uint64_t diff = a - b;
+        std::uint64_t c = carry((a ^ b) & (a ^ diff), a);
+        high = static_cast<std::int64_t>(static_cast<std::uint64_t>(aHigh) - static_cast<std::uint64_t>(bHigh) + c);
+        low = static_cast<std::int64_t>(diff);
+    }
+
+    inline double combine(std::int64_t high, std::int64_t low)
+    {
+        return static_cast<double>(high) * voxelSize + static_cast<double>(low);
+    }
+}
 
-    return { diffHigh, diffLow };
+VoxelCoords VoxelCoords::operator-(const VoxelCoords& other) const
+{
+    VoxelCoords result;
+    for (int i = 0; i < 3; ++i) {
+        subtractComponent(voxel[i], pos[i], other.voxel[i], other.pos[i], result.voxel[i], result.pos[i]);
+    }
+    return result;
 }
 
 VoxelCoords VoxelCoords::operator+(const VoxelCoords& other) const
 {
-    return { voxel + other.voxel, pos + other.pos };
+    VoxelCoords result;
+    for (int i = 0; i < 3; ++i) {
+        addComponent(voxel[i], pos[i], other.voxel[i], other.pos[i], result.voxel[i], result.pos[i]);
+    }
+    return result;
 }
 
 VoxelCoords& VoxelCoords::operator+=(const VoxelCoords& other)
@@ -26,4 +67,115 @@ VoxelCoords& VoxelCoords::operator-=(const VoxelCoords& other)
 {
     return *this = *this - other;
 }
+
+bool VoxelCoords::operator==(const VoxelCoords& other) const
+{
+    return voxel == other.voxel && pos == other.pos;
+}
+
+bool VoxelCoords::operator!=(const VoxelCoords& other) const
+{
+    return !(*this == other);
+}
+
+bool VoxelCoords::operator<(const VoxelCoords& other) const
+{
+    // pos spans less than one voxel, so comparing the voxel first and then
+    // pos orders the 128 bit values
+    for (int i = 0; i < 3; ++i) {
+        if (voxel[i] != other.voxel[i]) {
+            return voxel[i] < other.voxel[i];
+        }
+        if (pos[i] != other.pos[i]) {
+            return pos[i] < other.pos[i];
+        }
+    }
+    return false;
+}
+
+glm::dvec3 VoxelCoords::toMillimeters() const
+{
+    return { combine(voxel.x, pos.x), combine(voxel.y, pos.y), combine(voxel.z, pos.z) };
+}
+
+double distance(VoxelCoords const& a, VoxelCoords const& b)
+{
+    return glm::length((a - b).toMillimeters());
+}
+
+void VoxelCoordsArray::resize(std::size_t count)
+{
+    voxelX.resize(count);
+    voxelY.resize(count);
+    voxelZ.resize(count);
+    posX.resize(count);
+    posY.resize(count);
+    posZ.resize(count);
+}
+
+std::size_t VoxelCoordsArray::size() const
+{
+    return posX.size();
+}
+
+void VoxelCoordsArray::set(std::size_t i, VoxelCoords const& coords)
+{
+    voxelX[i] = coords.voxel.x;
+    voxelY[i] = coords.voxel.y;
+    voxelZ[i] = coords.voxel.z;
+    posX[i] = coords.pos.x;
+    posY[i] = coords.pos.y;
+    posZ[i] = coords.pos.z;
+}
+
+VoxelCoords VoxelCoordsArray::get(std::size_t i) const
+{
+    return { { voxelX[i], voxelY[i], voxelZ[i] }, { posX[i], posY[i], posZ[i] } };
+}
+
+// one component at a time, kept out of line so the pointers stay restrict
+__attribute__((noinline)) static void subtractKernel(std::size_t count,
+    std::int64_t const* __restrict high, std::int64_t const* __restrict low,
+    std::int64_t originHigh, std::int64_t originLow,
+    std::int64_t* __restrict outHigh, std::int64_t* __restrict outLow)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        subtractComponent(high[i], low[i], originHigh, originLow, outHigh[i], outLow[i]);
+    }
+}
+
+__attribute__((noinline)) static void offsetKernel(std::size_t count,
+    std::int64_t const* __restrict high, std::int64_t const* __restrict low,
+    std::int64_t originHigh, std::int64_t originLow, double* __restrict out)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        std::int64_t h, l;
+        subtractComponent(high[i], low[i], originHigh, originLow, h, l);
+        out[i] = combine(h, l);
+    }
+}
+
+void subtract(VoxelCoordsArray const& coords, VoxelCoords const& origin, VoxelCoordsArray& result)
+{
+    std::size_t count = coords.size();
+    result.resize(count);
+    subtractKernel(count, coords.voxelX.data(), coords.posX.data(), origin.voxel.x, origin.pos.x,
+        result.voxelX.data(), result.posX.data());
+    subtractKernel(count, coords.voxelY.data(), coords.posY.data(), origin.voxel.y, origin.pos.y,
+        result.voxelY.data(), result.posY.data());
+    subtractKernel(count, coords.voxelZ.data(), coords.posZ.data(), origin.voxel.z, origin.pos.z,
+        result.voxelZ.data(), result.posZ.data());
+}
+
+void relativeOffsets(VoxelCoordsArray const& coords, VoxelCoords const& origin,
+    std::vector<double>& x, std::vector<double>& y, std::vector<double>& z)
+{
+    std::size_t count = coords.size();
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+    offsetKernel(count, coords.voxelX.data(), coords.posX.data(), origin.voxel.x, origin.pos.x, x.data());
+    offsetKernel(count, coords.voxelY.data(), coords.posY.data(), origin.voxel.y, origin.pos.y, y.data());
+    offsetKernel(count, coords.voxelZ.data(), coords.posZ.data(), origin.voxel.z, origin.pos.z, z.data());
+}
 }
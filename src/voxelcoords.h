@@ -2,12 +2,17 @@
 #define VOXELCOORDS_H
 
 #include <glm/glm.hpp>
+#include <vector>
 
 namespace ou {
 
 // This coordinate system is 3.6*10^19 light years across
 // The actual observable universe is 9.3*10^10 light years across
 // So it is enough.
+//
+// Each component is a 128 bit integer in millimeters, voxel * 2^64 + pos.
+// pos is signed, so every pair of values is valid and a difference that
+// fits into pos, about a light year either way, has a voxel of zero.
 struct VoxelCoords {
     // approx. 1.94 light years across
     glm::i64vec3 voxel;
@@ -19,7 +24,39 @@ struct VoxelCoords {
     VoxelCoords operator+(VoxelCoords const& other) const;
     VoxelCoords& operator+=(VoxelCoords const& other);
     VoxelCoords& operator-=(VoxelCoords const& other);
+
+    bool operator==(VoxelCoords const& other) const;
+    bool operator!=(VoxelCoords const& other) const;
+
+    // by the exact value of x, then y, then z, e.g. for ordered containers
+    bool operator<(VoxelCoords const& other) const;
+
+    // in millimeters, rounded to double precision
+    glm::dvec3 toMillimeters() const;
+};
+
+// in millimeters, computed from the exact difference
+double distance(VoxelCoords const& a, VoxelCoords const& b);
+
+// Struct-of-arrays coordinates for offsetting many bodies at once. The
+// carries are computed without branches, so the loops vectorize.
+struct VoxelCoordsArray {
+    std::vector<std::int64_t> voxelX, voxelY, voxelZ;
+    std::vector<std::int64_t> posX, posY, posZ;
+
+    void resize(std::size_t count);
+    std::size_t size() const;
+
+    void set(std::size_t i, VoxelCoords const& coords);
+    VoxelCoords get(std::size_t i) const;
 };
+
+// coords[i] - origin, exactly
+void subtract(VoxelCoordsArray const& coords, VoxelCoords const& origin, VoxelCoordsArray& result);
+
+// coords[i] - origin in millimeters, e.g. camera relative positions
+void relativeOffsets(VoxelCoordsArray const& coords, VoxelCoords const& origin,
+    std::vector<double>& x, std::vector<double>& y, std::vector<double>& z);
 }
 
 #endif // VOXELCOORDS_H
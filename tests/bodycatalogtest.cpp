@@ -0,0 +1,77 @@
+#include "bodycatalog.h"
+#include "terrainnoise.h"
+
+#include <cstdio>
+#include <fstream>
+
+#include "gtest/gtest.h"
+
+using namespace ou;
+
+namespace {
+
+const char* const catalogPath = "bodycatalogtest.cat";
+
+std::vector<CatalogBody> testBodies()
+{
+    return {
+        { { { 0, 0, 0 }, { 1, 2, 3 } }, 6371000000000, 0.001, 0 },
+        { { { 1, -1, 0 }, { -4, 5, -6 } }, 4000000000000, 0.002, 3 },
+        { { { 0, 0, 0 }, { 7, 8, 9 } }, 1000000000000, 0.0015, 1 },
+    };
+}
+
+void truncateTo(std::string const& path, std::size_t size)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    bytes.resize(size);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+}
+
+TEST(BodyCatalog, ReadsBackWhatWasWritten)
+{
+    BodyCatalog::write(catalogPath, testBodies());
+    BodyCatalog catalog(catalogPath);
+
+    EXPECT_EQ(catalog.cellSize({ 0, 0, 0 }), 2u);
+    EXPECT_EQ(catalog.cellSize({ 1, -1, 0 }), 1u);
+    EXPECT_EQ(catalog.cellSize({ 5, 5, 5 }), 0u);
+
+    std::vector<CatalogBody> cell = catalog.readCell({ 0, 0, 0 });
+    ASSERT_EQ(cell.size(), 2u);
+    EXPECT_EQ(cell[0].position, testBodies()[0].position);
+    EXPECT_EQ(cell[1].position, testBodies()[2].position);
+    EXPECT_EQ(cell[1].radius, 1000000000000);
+
+    cell = catalog.readCell({ 1, -1, 0 });
+    ASSERT_EQ(cell.size(), 1u);
+    EXPECT_EQ(cell[0].noisePreset, 3);
+    EXPECT_DOUBLE_EQ(cell[0].terrainFactor, 0.002);
+    std::remove(catalogPath);
+}
+
+TEST(BodyCatalog, RejectsTruncatedFiles)
+{
+    // header of magic and cell count, then two 40 byte cell records
+    for (std::size_t size : { 4, 16, 40, 56 }) {
+        BodyCatalog::write(catalogPath, testBodies());
+        truncateTo(catalogPath, size);
+        EXPECT_THROW(BodyCatalog{ catalogPath }, std::runtime_error);
+    }
+    std::remove(catalogPath);
+}
+
+TEST(BodyCatalog, RejectsUnknownNoisePresets)
+{
+    std::vector<CatalogBody> bodies = testBodies();
+    bodies[1].noisePreset = static_cast<int>(noisePresets().size());
+    BodyCatalog::write(catalogPath, bodies);
+    BodyCatalog catalog(catalogPath);
+    EXPECT_EQ(catalog.readCell({ 0, 0, 0 }).size(), 2u);
+    EXPECT_THROW(catalog.readCell({ 1, -1, 0 }), std::runtime_error);
+    std::remove(catalogPath);
+}
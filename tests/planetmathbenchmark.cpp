@@ -0,0 +1,100 @@
+#include "planetmath.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+using namespace ou;
+
+// maps the same random unit vectors with the scalar and the batch functions
+// and the cubize table, timing them and checking that they agree
+int main()
+{
+    const std::size_t count = 1 << 16;
+    const int rounds = 20;
+
+    std::mt19937_64 rng(42);
+    std::normal_distribution<double> normal;
+    DVec3Array points;
+    points.resize(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        glm::dvec3 p = glm::normalize(glm::dvec3(normal(rng), normal(rng), normal(rng)));
+        points.x[i] = p.x;
+        points.y[i] = p.y;
+        points.z[i] = p.z;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    double sink = 0.0;
+
+    std::vector<CubeCoords> scalarCoords(count);
+    std::vector<FirstOrderDerivatives> scalarDerivs(count);
+    std::vector<SecondOrderDerivatives> scalarCurvs(count);
+    auto start = Clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        for (std::size_t i = 0; i < count; ++i) {
+            scalarCoords[i] = cubizePoint({ points.x[i], points.y[i], points.z[i] });
+            scalarDerivs[i] = derivatives(scalarCoords[i].pos, scalarCoords[i].side);
+            scalarCurvs[i] = curvature(scalarCoords[i].pos, scalarCoords[i].side);
+        }
+        sink += scalarCurvs[round].fxy.z;
+    }
+    std::chrono::duration<double, std::milli> scalarTime = Clock::now() - start;
+
+    CubeCoordsArray coords;
+    DVec3Array fx, fy, fxx, fxy, fyy;
+    start = Clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        cubizePoints(points, coords);
+        derivatives(coords, fx, fy);
+        curvature(coords, fxx, fxy, fyy);
+        sink += fxy.z[round];
+    }
+    std::chrono::duration<double, std::milli> batchTime = Clock::now() - start;
+
+    CubizeTable table;
+    std::vector<CubeCoords> tableCoords(count);
+    start = Clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        for (std::size_t i = 0; i < count; ++i) {
+            tableCoords[i] = table.cubize({ points.x[i], points.y[i], points.z[i] });
+        }
+        sink += tableCoords[round].pos.x;
+    }
+    std::chrono::duration<double, std::milli> tableTime = Clock::now() - start;
+
+    double maxError = 0.0;
+    double tableError = 0.0;
+    int sideMismatches = 0;
+    auto compare = [&](glm::dvec3 const& a, DVec3Array const& b, std::size_t i) {
+        maxError = std::max(maxError, std::abs(a.x - b.x[i]));
+        maxError = std::max(maxError, std::abs(a.y - b.y[i]));
+        maxError = std::max(maxError, std::abs(a.z - b.z[i]));
+    };
+    for (std::size_t i = 0; i < count; ++i) {
+        sideMismatches += scalarCoords[i].side != coords.side[i];
+        sideMismatches += scalarCoords[i].side != tableCoords[i].side;
+        tableError = std::max(tableError, std::abs(scalarCoords[i].pos.x - tableCoords[i].pos.x));
+        tableError = std::max(tableError, std::abs(scalarCoords[i].pos.y - tableCoords[i].pos.y));
+        maxError = std::max(maxError, std::abs(scalarCoords[i].pos.x - coords.x[i]));
+        maxError = std::max(maxError, std::abs(scalarCoords[i].pos.y - coords.y[i]));
+        compare(scalarDerivs[i].fx, fx, i);
+        compare(scalarDerivs[i].fy, fy, i);
+        compare(scalarCurvs[i].fxx, fxx, i);
+        compare(scalarCurvs[i].fxy, fxy, i);
+        compare(scalarCurvs[i].fyy, fyy, i);
+    }
+
+    const double samples = static_cast<double>(count) * rounds;
+    std::cout << "Scalar: " << scalarTime.count() * 1e6 / samples << "ns per point" << std::endl;
+    std::cout << "Batch: " << batchTime.count() * 1e6 / samples << "ns per point" << std::endl;
+    std::cout << "Speedup: " << scalarTime.count() / batchTime.count() << "x" << std::endl;
+    std::cout << "Table cubize: " << tableTime.count() * 1e6 / samples << "ns per point, max difference "
+              << tableError << " of " << table.maxError() << std::endl;
+    std::cout << "Max difference: " << maxError << ", side mismatches: " << sideMismatches
+              << " (" << sink << ")" << std::endl;
+
+    return sideMismatches == 0 && maxError < 1e-9 && tableError <= table.maxError() ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+#include "planetmath.h"
+
+#include <random>
+
+#include "gtest/gtest.h"
+
+using namespace ou;
+
+namespace {
+
+// random unit vectors, with every tenth one on a face edge or corner
+DVec3Array randomPoints(std::size_t count)
+{
+    std::mt19937_64 rng(5);
+    std::normal_distribution<double> normal;
+    DVec3Array points;
+    points.resize(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        glm::dvec3 p(normal(rng), normal(rng), normal(rng));
+        if (i % 10 == 0) {
+            p.y = std::copysign(std::abs(p.x), p.y);
+        }
+        if (i % 20 == 0) {
+            p.z = std::copysign(std::abs(p.x), p.z);
+        }
+        p = glm::normalize(p);
+        points.x[i] = p.x;
+        points.y[i] = p.y;
+        points.z[i] = p.z;
+    }
+    return points;
+}
+}
+
+TEST(CubizeTable, MaxErrorShrinksWithTheResolution)
+{
+    // the bounds documented in planetmath.h
+    EXPECT_LT(CubizeTable(16).maxError(), 7e-4);
+    EXPECT_LT(CubizeTable(64).maxError(), 4.5e-5);
+    EXPECT_LT(CubizeTable(256).maxError(), 3e-6);
+}
+
+TEST(CubizeTable, StaysWithinMaxErrorOfTheExactPath)
+{
+    DVec3Array points = randomPoints(20000);
+    CubeCoordsArray exact;
+    cubizePoints(points, exact);
+
+    for (int resolution : { 16, 64, 256 }) {
+        CubizeTable table(resolution);
+        for (std::size_t i = 0; i < points.size(); ++i) {
+            glm::dvec3 p(points.x[i], points.y[i], points.z[i]);
+            CubeCoords scalar = cubizePoint(p);
+            CubeCoords approx = table.cubize(p);
+
+            ASSERT_EQ(approx.side, scalar.side);
+            ASSERT_EQ(approx.side, exact.side[i]);
+            EXPECT_LE(std::abs(approx.pos.x - scalar.pos.x), table.maxError());
+            EXPECT_LE(std::abs(approx.pos.y - scalar.pos.y), table.maxError());
+            EXPECT_LE(std::abs(approx.pos.x - exact.x[i]), table.maxError() + 1e-12);
+            EXPECT_LE(std::abs(approx.pos.y - exact.y[i]), table.maxError() + 1e-12);
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#include "planetmesh.h"
+
+#include "gtest/gtest.h"
+
+using namespace ou;
+
+TEST(PlanetMesh, CacheMissRatioCountsFifoMisses)
+{
+    // two triangles sharing an edge, then one reusing a vertex the cache of
+    // three has dropped by then
+    std::vector<std::uint32_t> indices = { 0, 1, 2, 2, 1, 3, 0, 3, 2 };
+    EXPECT_DOUBLE_EQ(averageCacheMissRatio(indices, 3), 5.0 / 3.0);
+    EXPECT_DOUBLE_EQ(averageCacheMissRatio(indices, 4), 4.0 / 3.0);
+    EXPECT_DOUBLE_EQ(averageCacheMissRatio({}, 16), 0.0);
+}
+
+TEST(PlanetMesh, VerticesAreStoredInOrderOfFirstUse)
+{
+    PlanetMesh mesh = buildPlanetMesh(32);
+    std::uint32_t next = 0;
+    for (std::uint32_t index : mesh.indices) {
+        ASSERT_LE(index, next);
+        if (index == next) {
+            ++next;
+        }
+    }
+    EXPECT_EQ(next, mesh.vertices.size());
+}
+
+TEST(PlanetMesh, StripsKeepAboutOneMissPerTwoTriangles)
+{
+    for (int gridSize : { 32, 64 }) {
+        PlanetMesh mesh = buildPlanetMesh(gridSize);
+        PlanetMesh rows = buildPlanetMesh(gridSize, gridSize);
+        for (int cacheSize : { 16, 32 }) {
+            double acmr = averageCacheMissRatio(mesh.indices, cacheSize);
+            EXPECT_LT(acmr, 0.6) << "gridSize " << gridSize << ", cache " << cacheSize;
+
+            // whole rows no longer fit, and miss nearly every vertex again
+            EXPECT_LT(acmr, averageCacheMissRatio(rows.indices, cacheSize) * .7);
+        }
+    }
+}
@@ -0,0 +1,101 @@
+#include "planetmath.h"
+#include "terrainpyramid.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "gtest/gtest.h"
+
+using namespace ou;
+
+namespace {
+
+const std::int64_t radius = 1000000000; // 1000 km
+const double height = 1e6; // 1 km
+
+// flat terrain at the given height on all six faces
+TerrainPyramid flatPlanet(int size)
+{
+    TerrainPyramid pyramid;
+    pyramid.setRadius(radius);
+    for (int side = 0; side < 6; ++side) {
+        std::vector<glm::dvec2> leaves(size * size, glm::dvec2(height));
+        pyramid.setLayer(side, side, 0, glm::dvec2(0.0), 1.0, 1024, size, leaves);
+    }
+    return pyramid;
+}
+
+// ray from above the surface that first touches it at the given direction,
+// coming in at a shallow angle from along the tangent's direction
+void expectHitAt(TerrainPyramid const& pyramid, glm::dvec3 direction, glm::dvec3 const& tangent,
+    double along, double above, double tolerance)
+{
+    direction = glm::normalize(direction);
+    glm::dvec3 target = direction * (radius + height);
+    glm::dvec3 origin = target + direction * above;
+    if (along > 0.0) {
+        origin += glm::normalize(tangent - direction * glm::dot(tangent, direction)) * along;
+    }
+    glm::dvec3 ray = target - origin;
+
+    TerrainRayHit hit = pyramid.raycast(origin, ray, 1e12);
+    ASSERT_TRUE(hit.hit);
+    EXPECT_NEAR(hit.distance, glm::length(ray), tolerance);
+}
+}
+
+TEST(TerrainPyramid, VerticalRaysHitFlatTerrain)
+{
+    TerrainPyramid pyramid = flatPlanet(64);
+    for (glm::dvec3 direction : { glm::dvec3(0, 0, 1), glm::dvec3(.3, -.2, 1), glm::dvec3(-1, .5, .1) }) {
+        expectHitAt(pyramid, direction, glm::dvec3(0.0), 0.0, 5e6, 1.0);
+    }
+}
+
+TEST(TerrainPyramid, RaysHitAcrossFaceEdges)
+{
+    TerrainPyramid pyramid = flatPlanet(64);
+
+    // on edges and corners, and shallow rays whose hit is on another face
+    // than their origin
+    expectHitAt(pyramid, glm::dvec3(1, 1, .3), glm::dvec3(0.0), 0.0, 5e6, 1.0);
+    expectHitAt(pyramid, glm::dvec3(1, 1, 1), glm::dvec3(0.0), 0.0, 5e6, 1.0);
+    expectHitAt(pyramid, glm::dvec3(.9, 1, .2), glm::dvec3(1, -1, 0), 3e8, 2e7, 1.0);
+    expectHitAt(pyramid, glm::dvec3(1, .95, .97), glm::dvec3(-1, 1, -1), 3e8, 2e7, 1.0);
+}
+
+TEST(TerrainPyramid, LongGrazingRaysHit)
+{
+    // the +z face is low for y < 0 and high above it; the other faces are low
+    const int size = 256;
+    TerrainPyramid pyramid;
+    pyramid.setRadius(radius);
+    for (int side = 0; side < 6; ++side) {
+        std::vector<glm::dvec2> leaves(size * size, glm::dvec2(0.0));
+        if (side == 4) {
+            std::fill(leaves.begin() + size * size / 2, leaves.end(), glm::dvec2(2 * height));
+        }
+        pyramid.setLayer(side, side, 0, glm::dvec2(0.0), 1.0, 1024, size, leaves);
+    }
+
+    // a 30 km ray grazing the low half a meter from the high one, which only
+    // allows steps as long as the ray's distance to it
+    const double offset = 500.0;
+    glm::dvec3 target = glm::normalize(glm::dvec3(.1, 0, 1)) * std::sqrt(double(radius) * radius - offset * offset);
+    target.y = -offset;
+    glm::dvec3 along = glm::normalize(glm::cross(glm::dvec3(0, 1, 0), target));
+    glm::dvec3 origin = target + along * 3e7 + glm::normalize(target) * 2e5;
+
+    TerrainRayHit hit = pyramid.raycast(origin, target - origin, 1e12);
+    ASSERT_TRUE(hit.hit);
+    EXPECT_NEAR(hit.distance, glm::length(target - origin), 1.0);
+}
+
+TEST(TerrainPyramid, RaysAwayFromThePlanetMiss)
+{
+    TerrainPyramid pyramid = flatPlanet(64);
+    glm::dvec3 origin(0, 0, radius + 5e6);
+    EXPECT_FALSE(pyramid.raycast(origin, glm::dvec3(0, 0, 1), 1e12).hit);
+    EXPECT_FALSE(pyramid.raycast(origin, glm::dvec3(1, 0, 0), 1e12).hit);
+    EXPECT_FALSE(pyramid.raycast(origin, glm::dvec3(0, 0, -1), 1e6).hit);
+}
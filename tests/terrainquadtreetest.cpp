@@ -0,0 +1,149 @@
+#include "terrainpyramid.h"
+#include "terrainquadtree.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#include "gtest/gtest.h"
+
+using namespace ou;
+
+namespace {
+
+const double radius = 1e9; // 1000 km
+const double altitude = 1e7; // 10 km
+const int finestLod = 6;
+
+const glm::dvec3 down(0, 0, -1);
+const glm::dvec3 towardTheHorizon(0, 1, -.1);
+
+// the six faces, and layers of every lod centered under the eye on +z
+std::vector<QuadtreeLayer> testLayers()
+{
+    std::vector<QuadtreeLayer> layers;
+    for (int side = 0; side < 6; ++side) {
+        layers.push_back({ side, 0, glm::dvec2(0.0), 1.0 });
+    }
+    for (int lod = 1; lod <= finestLod; ++lod) {
+        layers.push_back({ 4, lod, glm::dvec2(0.0), glm::exp2(-double(lod)) });
+    }
+    return layers;
+}
+
+// flat terrain at sea level, or none generated yet
+TerrainPyramid testPyramid(bool generated)
+{
+    TerrainPyramid pyramid;
+    pyramid.setRadius(std::int64_t(radius));
+    for (int side = 0; generated && side < 6; ++side) {
+        pyramid.setLayer(side, side, 0, glm::dvec2(0.0), 1.0, 1024, 16, std::vector<glm::dvec2>(16 * 16, glm::dvec2(0.0)));
+    }
+    return pyramid;
+}
+
+// above the center of +z with a 90 degree field of view
+QuadtreeView testView(glm::dvec3 const& lookDirection)
+{
+    QuadtreeView view;
+    view.eye = { 0, 0, radius + altitude };
+    view.unit = 1e6;
+    view.viewProj = glm::perspective(glm::radians(90.0), 1.0, 0.1, 10.0)
+        * glm::lookAt(glm::dvec3(0.0), lookDirection, glm::dvec3(1, 0, 0));
+    view.planetRadius = radius;
+    view.occluderRadius = radius;
+    view.pixelsPerRadian = 300;
+    view.maxPixelError = 2;
+    view.gridSize = 64;
+    view.textureSize = 1024;
+    view.maxDepth = 16;
+    return view;
+}
+}
+
+TEST(TerrainQuadtree, NodesCarryTheLodOfTheirLayer)
+{
+    std::vector<QuadtreeLayer> layers = testLayers();
+    TerrainPyramid pyramid = testPyramid(true);
+    TerrainQuadtree quadtree(testView(down), layers, pyramid);
+
+    std::vector<QuadtreeNode> nodes = quadtree.select();
+    ASSERT_FALSE(nodes.empty());
+    for (QuadtreeNode const& node : nodes) {
+        QuadtreeLayer const& layer = layers[node.layer];
+        EXPECT_EQ(node.lod, layer.lod);
+        EXPECT_EQ(node.side, layer.side);
+
+        // inside the layer, and with at least a texel per grid cell
+        glm::dvec2 extent = glm::abs(node.center - layer.center) + node.scale;
+        EXPECT_LE(std::max(extent.x, extent.y), layer.scale * (1 + 1e-9));
+        EXPECT_GE(1024 * node.scale / layer.scale, 64);
+
+        // and from the finest layer covering it
+        for (QuadtreeLayer const& finer : layers) {
+            glm::dvec2 finerExtent = glm::abs(node.center - finer.center) + node.scale;
+            if (finer.side == node.side && finer.lod > layer.lod) {
+                EXPECT_GT(std::max(finerExtent.x, finerExtent.y), finer.scale * (1 + 1e-9));
+            }
+        }
+    }
+}
+
+TEST(TerrainQuadtree, RefinesTowardTheEye)
+{
+    std::vector<QuadtreeLayer> layers = testLayers();
+    TerrainPyramid pyramid = testPyramid(true);
+    TerrainQuadtree quadtree(testView(towardTheHorizon), layers, pyramid);
+    std::vector<QuadtreeNode> nodes = quadtree.select();
+    ASSERT_FALSE(nodes.empty());
+
+    // the nearest node is among the deepest and from the finest layer, and
+    // nodes twice as far as others are no deeper than them
+    auto nearest = std::min_element(nodes.begin(), nodes.end(), [](QuadtreeNode const& a, QuadtreeNode const& b) {
+        return glm::length(a.center) < glm::length(b.center);
+    });
+    EXPECT_EQ(nearest->lod, finestLod);
+    int shallowest = nearest->depth;
+    for (QuadtreeNode const& node : nodes) {
+        EXPECT_LE(node.depth, nearest->depth);
+        shallowest = std::min(shallowest, node.depth);
+        for (QuadtreeNode const& other : nodes) {
+            if (glm::length(node.center) - node.scale * std::sqrt(2.0) > 2 * (glm::length(other.center) + other.scale * std::sqrt(2.0))) {
+                EXPECT_LE(node.depth, other.depth);
+            }
+        }
+    }
+    EXPECT_GE(nearest->depth - shallowest, 3);
+}
+
+TEST(TerrainQuadtree, CullsOutsideTheFrustumAndBehindTheHorizon)
+{
+    std::vector<QuadtreeLayer> layers = testLayers();
+    TerrainPyramid pyramid = testPyramid(true);
+    TerrainQuadtree quadtree(testView(down), layers, pyramid);
+    std::vector<QuadtreeNode> nodes = quadtree.select();
+
+    // from 10 km up the horizon is about 8 degrees away, well short of the
+    // other faces, and the view only reaches about 10 km to each side
+    EXPECT_GT(quadtree.stats().horizonCulled, 0);
+    EXPECT_GT(quadtree.stats().frustumCulled, 0);
+    for (QuadtreeNode const& node : nodes) {
+        EXPECT_EQ(node.side, 4);
+        EXPECT_LT(glm::length(node.center) - node.scale * std::sqrt(2.0), 0.05);
+    }
+}
+
+TEST(TerrainQuadtree, CullsNothingBeforeTheTerrainArrives)
+{
+    std::vector<QuadtreeLayer> layers = testLayers();
+    TerrainPyramid pyramid = testPyramid(false);
+    TerrainQuadtree quadtree(testView(down), layers, pyramid);
+    std::vector<QuadtreeNode> nodes = quadtree.select();
+
+    EXPECT_EQ(quadtree.stats().horizonCulled, 0);
+    EXPECT_EQ(quadtree.stats().frustumCulled, 0);
+    for (int side = 0; side < 6; ++side) {
+        EXPECT_TRUE(std::any_of(nodes.begin(), nodes.end(), [side](QuadtreeNode const& node) { return node.side == side; }));
+    }
+}
@@ -0,0 +1,198 @@
+#include "entitysystems/shaders.h"
+#include "terrainnoise.h"
+
+#include <cmath>
+#include <random>
+
+#include "gtest/gtest.h"
+
+using namespace ou;
+
+namespace {
+
+// main() of terrain.comp, transcribed with the #defines of a preset as
+// runtime values
+struct ShaderReference {
+    NoiseBasis basis;
+    TerrainShape shape;
+    float maxFreq;
+
+    float basisNoise(glm::vec3 v) const
+    {
+        if (basis == NoiseBasis::IntegerHash) {
+            glm::vec3 cell = glm::floor(v);
+            return hashNoise(glm::i64vec3(cell), v - cell);
+        }
+        return simplexNoise(v);
+    }
+
+    float ridgeNoise(glm::vec3 v) const
+    {
+        float n = basisNoise(v);
+        float ridge = 2 * (.5f - std::abs(0.5f - n));
+        float e = float(shape.ridgeExponent.num) / float(shape.ridgeExponent.den);
+        return e == 1.0f ? ridge : std::copysign(std::pow(std::abs(ridge), e), ridge);
+    }
+
+    float octaveWeight(float freq) const
+    {
+        return 1 - glm::smoothstep(.5f * maxFreq, maxFreq, freq);
+    }
+
+    static float octaveAmplitude(int octaves, float persistence)
+    {
+        return persistence == 1.0f ? float(octaves) : (1 - std::pow(persistence, float(octaves))) / (1 - persistence);
+    }
+
+    template <typename Noise>
+    float octaves(glm::vec3 pos, int octaves, float freq, float persistence, Noise noise) const
+    {
+        float total = 0.0f;
+        float amplitude = 1.0f;
+        for (int i = 0; i < octaves; ++i) {
+            float weight = octaveWeight(freq);
+            if (weight <= 0) {
+                break;
+            }
+            total += noise(pos * freq) * amplitude * weight;
+            freq *= 2.0f;
+            amplitude *= persistence;
+        }
+        return total / octaveAmplitude(octaves, persistence);
+    }
+
+    float height(glm::vec3 pos) const
+    {
+        auto ridge = [this](glm::vec3 v) { return ridgeNoise(v); };
+        auto plain = [this](glm::vec3 v) { return basisNoise(v); };
+        auto worley = [](glm::vec3 v) {
+            float n = cellularNoise(v);
+            return n * n * n;
+        };
+
+        auto sum = [&](OctaveSum const& s, auto noise) {
+            return octaves(pos, s.octaves, s.frequency, s.persistence, noise);
+        };
+
+        float height = sum(shape.ridges, ridge) * shape.ridgeScale + shape.ridgeOffset;
+        float n = sum(shape.mask, plain);
+        float mul = glm::clamp(n * n * n * shape.maskGain, 0.0f, 1.0f);
+        float mountains = sum(shape.cells, worley) * shape.cellScale + shape.cellOffset;
+        mountains += sum(shape.mountains, ridge) + shape.mountainOffset;
+        return height + mul * mountains;
+    }
+};
+
+std::vector<glm::vec3> randomDirections(int count)
+{
+    std::mt19937 rng(7);
+    std::normal_distribution<float> normal;
+    std::vector<glm::vec3> directions;
+    for (int i = 0; i < count; ++i) {
+        directions.push_back(glm::normalize(glm::vec3(normal(rng), normal(rng), normal(rng))));
+    }
+    return directions;
+}
+}
+
+TEST(TerrainShape, CpuElevationMatchesShader)
+{
+    for (NoisePreset const& preset : noisePresets()) {
+        for (float maxFreq : { 64.0f, 256.0f, 4096.0f }) {
+            ShaderReference shader{ preset.basis, preset.shape, maxFreq };
+            for (glm::vec3 const& direction : randomDirections(200)) {
+                EXPECT_NEAR(topLevelElevation(direction, preset, maxFreq), shader.height(direction), 1e-4f)
+                    << preset.name;
+            }
+        }
+    }
+}
+
+TEST(TerrainShape, ShaderIsCompiledWithThePreset)
+{
+    std::string source = terrainShaderSource(findNoisePreset("earthlike"));
+    EXPECT_EQ(source.find("\n#version 430\n#define RIDGE_OCTAVES 8\n"), 0u);
+    EXPECT_NE(source.find("#define MASK_GAIN 30.0"), std::string::npos);
+    EXPECT_NE(source.find("#define MOUNTAIN_OCTAVES 11\n"), std::string::npos);
+    EXPECT_NE(source.find("#define BASIS 0\n"), std::string::npos);
+
+    source = terrainShaderSource(findNoisePreset("rugged-hash"));
+    EXPECT_NE(source.find("#define RIDGE_EXPONENT_NUM 3\n#define RIDGE_EXPONENT_DEN 2\n"), std::string::npos);
+    EXPECT_NE(source.find("#define BASIS 1\n"), std::string::npos);
+}
+
+TEST(TerrainShape, PresetsAreFoundByName)
+{
+    for (NoisePreset const& preset : noisePresets()) {
+        EXPECT_EQ(&findNoisePreset(preset.name), &preset);
+    }
+    EXPECT_THROW(findNoisePreset("nonexistent"), std::runtime_error);
+}
+
+namespace {
+
+// fraction of points where the gradient agrees with central differences
+// along two tangents; kinks in the ridges, the mask clamp and the cells make
+// a few points disagree
+template <typename Function>
+float gradientAgreement(Function f, float h, float tolerance)
+{
+    std::vector<glm::vec3> points = randomDirections(500);
+    int agreeing = 0;
+    for (glm::vec3 const& p : points) {
+        glm::vec3 gradient;
+        f(p, gradient);
+
+        glm::vec3 t1 = glm::normalize(glm::cross(p, std::abs(p.x) < .9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0)));
+        glm::vec3 t2 = glm::cross(p, t1);
+        bool agrees = true;
+        for (glm::vec3 const& t : { t1, t2 }) {
+            glm::vec3 g;
+            float difference = (f(p + t * h, g) - f(p - t * h, g)) / (2 * h);
+            float analytic = glm::dot(gradient, t);
+            agrees = agrees && std::abs(difference - analytic) <= tolerance * (std::abs(analytic) + 1);
+        }
+        agreeing += agrees;
+    }
+    return float(agreeing) / float(points.size());
+}
+}
+
+TEST(TerrainShape, NoiseGradientsMatchDifferences)
+{
+    auto simplex = [](glm::vec3 v, glm::vec3& g) {
+        float n = simplexNoise(v * 3.0f, g);
+        g *= 3.0f;
+        return n;
+    };
+    auto hash = [](glm::vec3 v, glm::vec3& g) {
+        glm::vec3 cell = glm::floor(v * 3.0f);
+        float n = hashNoise(glm::i64vec3(cell), v * 3.0f - cell, g);
+        g *= 3.0f;
+        return n;
+    };
+    auto cells = [](glm::vec3 v, glm::vec3& g) {
+        float n = cellularNoise(v * 3.0f, g);
+        g *= 3.0f;
+        return n;
+    };
+    EXPECT_GT(gradientAgreement(simplex, 1e-3f, 1e-2f), 0.99f);
+    EXPECT_GT(gradientAgreement(hash, 1e-3f, 1e-2f), 0.99f);
+    EXPECT_GT(gradientAgreement(cells, 1e-3f, 1e-2f), 0.95f);
+}
+
+TEST(TerrainShape, ElevationGradientMatchesDifferences)
+{
+    const float maxFreq = 64.0f;
+    for (NoisePreset const& preset : noisePresets()) {
+        for (glm::vec3 const& direction : randomDirections(100)) {
+            glm::vec3 gradient;
+            EXPECT_NEAR(topLevelElevation(direction, preset, maxFreq, gradient),
+                topLevelElevation(direction, preset, maxFreq), 1e-5f)
+                << preset.name;
+        }
+
+        auto elevation = [&](glm::vec3 p, glm::vec3& g) { return topLevelElevation(p, preset, maxFreq, g); };
+        EXPECT_GT(gradientAgreement(elevation, 1e-4f, 5e-2f), 0.9f) << preset.name;
+    }
+}
@@ -0,0 +1,107 @@
+#include "voxelcoords.h"
+
+#include <limits>
+#include <random>
+
+#include "gtest/gtest.h"
+
+using namespace ou;
+
+namespace {
+
+__extension__ typedef __int128 int128;
+
+int128 value(std::int64_t voxel, std::int64_t pos)
+{
+    return int128(voxel) * (int128(1) << 64) + pos;
+}
+
+// random components, with a third of them at or next to the limits of pos
+std::vector<VoxelCoords> testCoords(int count)
+{
+    const std::int64_t max = std::numeric_limits<std::int64_t>::max();
+    const std::int64_t min = std::numeric_limits<std::int64_t>::min();
+    const std::int64_t edges[] = { min, min + 1, -1, 0, 1, max - 1, max };
+
+    std::mt19937_64 rng(41);
+    std::uniform_int_distribution<std::int64_t> any(min, max);
+    std::uniform_int_distribution<std::int64_t> smallVoxel(-3, 3);
+    std::uniform_int_distribution<int> edge(0, 6), kind(0, 2);
+
+    std::vector<VoxelCoords> coords(count);
+    for (VoxelCoords& c : coords) {
+        for (int i = 0; i < 3; ++i) {
+            c.voxel[i] = smallVoxel(rng);
+            c.pos[i] = kind(rng) == 0 ? edges[edge(rng)] : any(rng);
+        }
+    }
+    return coords;
+}
+}
+
+TEST(VoxelCoords, ArithmeticCarriesLike128BitIntegers)
+{
+    std::vector<VoxelCoords> coords = testCoords(300);
+    for (std::size_t k = 0; k + 1 < coords.size(); ++k) {
+        VoxelCoords const& a = coords[k];
+        VoxelCoords const& b = coords[k + 1];
+        VoxelCoords sum = a + b, diff = a - b;
+        for (int i = 0; i < 3; ++i) {
+            int128 x = value(a.voxel[i], a.pos[i]), y = value(b.voxel[i], b.pos[i]);
+            EXPECT_TRUE(value(sum.voxel[i], sum.pos[i]) == x + y);
+            EXPECT_TRUE(value(diff.voxel[i], diff.pos[i]) == x - y);
+        }
+        EXPECT_EQ(diff + b, a);
+    }
+}
+
+TEST(VoxelCoords, SmallDifferencesHaveNoVoxel)
+{
+    VoxelCoords a{ { 5, -2, 0 }, { std::numeric_limits<std::int64_t>::max() - 10, std::numeric_limits<std::int64_t>::min(), 0 } };
+    VoxelCoords b{ { 6, -3, 0 }, { std::numeric_limits<std::int64_t>::min() + 10, std::numeric_limits<std::int64_t>::max(), 0 } };
+    VoxelCoords diff = b - a;
+    EXPECT_EQ(diff.voxel, glm::i64vec3(0));
+    EXPECT_EQ(diff.pos, glm::i64vec3(21, -1, 0));
+}
+
+TEST(VoxelCoords, OrderFollows128BitValues)
+{
+    std::vector<VoxelCoords> coords = testCoords(200);
+    for (VoxelCoords const& a : coords) {
+        for (VoxelCoords const& b : coords) {
+            bool less = false;
+            for (int i = 0; i < 3; ++i) {
+                int128 x = value(a.voxel[i], a.pos[i]), y = value(b.voxel[i], b.pos[i]);
+                if (x != y) {
+                    less = x < y;
+                    break;
+                }
+            }
+            EXPECT_EQ(a < b, less);
+        }
+    }
+}
+
+TEST(VoxelCoords, ArrayKernelsMatchScalar)
+{
+    std::vector<VoxelCoords> coords = testCoords(64);
+    VoxelCoords origin = coords.back();
+
+    VoxelCoordsArray array;
+    array.resize(coords.size());
+    for (std::size_t i = 0; i < coords.size(); ++i) {
+        array.set(i, coords[i]);
+    }
+
+    VoxelCoordsArray result;
+    subtract(array, origin, result);
+    std::vector<double> x, y, z;
+    relativeOffsets(array, origin, x, y, z);
+    for (std::size_t i = 0; i < coords.size(); ++i) {
+        EXPECT_EQ(result.get(i), coords[i] - origin);
+        glm::dvec3 offset = (coords[i] - origin).toMillimeters();
+        EXPECT_DOUBLE_EQ(x[i], offset.x);
+        EXPECT_DOUBLE_EQ(y[i], offset.y);
+        EXPECT_DOUBLE_EQ(z[i], offset.z);
+    }
+}
@@ -0,0 +1,55 @@
+#include "bodycatalog.h"
+#include "terrainnoise.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+
+using namespace ou;
+
+// Writes a body catalog of random planets for the renderer to stream, e.g.
+//   makeCatalog bodies.cat 3 20
+// puts 20 planets into every voxel up to 3 away from the origin voxel.
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <catalog> [voxel radius] [bodies per voxel] [seed]\n";
+        return 1;
+    }
+    int voxelRadius = argc > 2 ? std::atoi(argv[2]) : 1;
+    int perVoxel = argc > 3 ? std::atoi(argv[3]) : 10;
+    unsigned seed = argc > 4 ? static_cast<unsigned>(std::atoi(argv[4])) : 1u;
+
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<std::int64_t> pos(std::numeric_limits<std::int64_t>::min(),
+        std::numeric_limits<std::int64_t>::max());
+    std::uniform_int_distribution<std::int64_t> radius(1000000000000, 8000000000000); // 1000 to 8000 km
+    std::uniform_real_distribution<double> terrainFactor(0.0005, 0.002);
+    std::uniform_int_distribution<int> preset(0, static_cast<int>(noisePresets().size()) - 1);
+
+    std::vector<CatalogBody> bodies;
+    for (std::int64_t z = -voxelRadius; z <= voxelRadius; ++z) {
+        for (std::int64_t y = -voxelRadius; y <= voxelRadius; ++y) {
+            for (std::int64_t x = -voxelRadius; x <= voxelRadius; ++x) {
+                for (int i = 0; i < perVoxel; ++i) {
+                    CatalogBody body;
+                    body.position = { { x, y, z }, { pos(rng), pos(rng), pos(rng) } };
+                    body.radius = radius(rng);
+                    body.terrainFactor = terrainFactor(rng);
+                    body.noisePreset = preset(rng);
+                    bodies.push_back(body);
+                }
+            }
+        }
+    }
+
+    try {
+        BodyCatalog::write(argv[1], bodies);
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    std::cout << "Wrote " << bodies.size() << " bodies to " << argv[1] << "\n";
+    return 0;
+}